@@ -0,0 +1,107 @@
+#include "server.h"
+#include "context.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_STATEMENTS 200000
+#define BENCH_EDITS 2000
+#define BENCH_DISTANCE 4096
+
+static char* generateSource(size_t* length)
+{
+    size_t capacity = BENCH_STATEMENTS * 48;
+    char* source = safeMalloc(capacity + 2);
+    size_t size = 0;
+
+    for (int i = 0; i < BENCH_STATEMENTS; i++) {
+        if (i % 4 == 3) {
+            size += sprintf(source + size, "value%d * (value%d - %d) + %d;\n", i - 1, i - 2, i % 97, i % 7);
+        } else if (i > 0) {
+            int previous = i % 4 == 0 ? i - 2 : i - 1;
+            size += sprintf(source + size, "const value%d = value%d + %d;\n", i, previous, i % 89);
+        } else {
+            size += sprintf(source + size, "const value0 = 1;\n");
+        }
+    }
+
+    source[size] = '\0';
+    source[size + 1] = '\0';
+    *length = size;
+
+    return source;
+}
+
+static double now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// Edits type a digit after the integer literal ending a statement that
+// declares nothing, near the previous edit, and delete it again. Constants
+// are propagated, so changing a declaration would parse again every
+// statement depending on it, which here is the rest of the module.
+static size_t findLiteral(char* source, size_t length, size_t previous, unsigned int* seed)
+{
+    while (true) {
+        *seed = *seed * 1103515245 + 12345;
+        size_t index = (previous + (*seed >> 16) % BENCH_DISTANCE) % length;
+        char* semicolon = memchr(source + index, ';', length - index);
+
+        if (semicolon == NULL || semicolon[-1] < '0' || semicolon[-1] > '9') {
+            continue;
+        }
+
+        char* line = semicolon;
+
+        while (line > source && line[-1] != '\n') {
+            line--;
+        }
+
+        if (strncmp(line, "const", 5)) {
+            return semicolon - source;
+        }
+    }
+}
+
+int main()
+{
+    size_t length;
+    char* source = generateSource(&length);
+    FILE* output = fopen("/dev/null", "w");
+    CompilerContext* context = newCompilerContext();
+    double start = now();
+    Document* document = openDocument(context, "bench", source, length);
+    writeDiagnostics(document, output);
+    double open = now() - start;
+    unsigned int seed = 1;
+    size_t index = 0;
+
+    start = now();
+
+    for (int i = 0; i < BENCH_EDITS; i += 2) {
+        Module* module = document->context->module;
+        index = findLiteral(module->source, module->length, index, &seed);
+        char digit = '0' + (seed >> 16) % 10;
+        editDocument(document, index, index, &digit, 1);
+        writeDiagnostics(document, output);
+        editDocument(document, index, index + 1, "", 0);
+        writeDiagnostics(document, output);
+    }
+
+    double edits = now() - start;
+
+    printf("open: %zu bytes, %d statements, %.3f s\n", length, BENCH_STATEMENTS, open);
+    printf("edit: %d edits, %.1f us/edit, %.0fx faster than reopening\n",
+        BENCH_EDITS, edits / BENCH_EDITS * 1e6, open / (edits / BENCH_EDITS));
+    freeDocument(document);
+    freeCompilerContext(context);
+    fclose(output);
+
+    return 0;
+}
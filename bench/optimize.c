@@ -0,0 +1,100 @@
+#include "module.h"
+#include "scan.h"
+#include "parse.h"
+#include "ir.h"
+#include "optimize.h"
+#include "context.h"
+#include "error.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_STATEMENTS 20000
+#define BENCH_REGISTERS 4
+
+// Every statement reads the previous one, so nothing is dead and only the
+// repeated subexpressions can be removed.
+static const char* statements[] = {
+    "const value%d = (value%d * x) + (value%d * x) - y;\n",
+    "const value%d = (value%d + y) / 4 + (value%d + y) %% 4;\n",
+    "const value%d = value%d * 3 + x * y - (x * y) / 5;\n",
+    "const value%d = (value%d - x) * (value%d - x) ^ 2;\n",
+    "const value%d = value%d + x / 7 - y %% 9;\n",
+    "const value%d = -(value%d * y) + (value%d * y) / 3 + x;\n",
+};
+
+static Module* generateModule()
+{
+    size_t count = sizeof(statements) / sizeof(statements[0]);
+    size_t capacity = BENCH_STATEMENTS * 80;
+    char* source = safeMalloc(capacity + 2);
+    size_t length = sprintf(source, "const x;\nconst y;\nconst value0 = x + y;\n");
+    unsigned int seed = 1;
+
+    for (int i = 1; i < BENCH_STATEMENTS; i++) {
+        seed = seed * 1103515245 + 12345;
+        length += sprintf(source + length, statements[(seed >> 16) % count], i, i - 1, i - 1);
+    }
+
+    length += sprintf(source + length, "value%d;\n", BENCH_STATEMENTS - 1);
+    source[length] = '\0';
+    source[length + 1] = '\0';
+
+    return newModuleFromSource("bench", source, length);
+}
+
+static double now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static int countInstructions(IR* ir)
+{
+    int count = 0;
+
+    for (VECTOR_EACH(ir->procedures)) {
+        count += VECTOR_SIZE(((Procedure*) VECTOR_GET(ir->procedures, i))->instructions);
+    }
+
+    return count;
+}
+
+int main()
+{
+    CompilerContext* context = newCompilerContext();
+    context->module = generateModule();
+    TokenBuffer* tokens = scan(context);
+    Ast* ast = parse(context, tokens);
+    optimizeAst(context, ast);
+
+    if (hasErrors(context)) {
+        printf("optimize: the generated corpus doesn't compile\n");
+
+        return 1;
+    }
+
+    IR* ir = generateIR(context, ast);
+    reduceStrength(context, ir, BENCH_REGISTERS);
+    int before = countInstructions(ir);
+    double start = now();
+    numberValues(context, ir, BENCH_REGISTERS);
+    double elapsed = now() - start;
+    int numbered = countInstructions(ir);
+    removeDeadCode(context, ir);
+    int after = countInstructions(ir);
+
+    printf("optimize: %d statements, %d instructions\n", BENCH_STATEMENTS, before);
+    printf("value numbering: %d removed (%.1f%%), %.3f s\n",
+        before - numbered, 100.0 * (before - numbered) / before, elapsed);
+    printf("dead code: %d removed, %d left\n", numbered - after, after);
+    freeIR(ir);
+    freeTokenBuffer(tokens);
+    freeCompilerContext(context);
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "module.h"
+#include "scan.h"
+#include "context.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_SIZE (32 << 20)
+#define BENCH_RUNS 5
+
+static const char* statements[] = {
+    "const value = 12345 + other * 3;\n",
+    "result += (first - second) / 4 % 7;\n",
+    "if (left <= right && flag != false) { counter = counter + 1; }\n",
+    "// a single line comment\n",
+    "/* a multiple lines\n   comment */\n",
+    "name = \"a string literal\";\n",
+    "while (index < 100) { index *= 2; }\n",
+    "character = 'c';\n",
+    "ratio = 3.14159 ^ 2;\n",
+    "    \t\n",
+};
+
+static Module* generateModule()
+{
+    size_t count = sizeof(statements) / sizeof(statements[0]);
+    char* source = safeMalloc(BENCH_SIZE + 128);
+    size_t length = 0;
+    unsigned int seed = 1;
+
+    while (length < BENCH_SIZE) {
+        seed = seed * 1103515245 + 12345;
+        const char* statement = statements[(seed >> 16) % count];
+        size_t statementLength = strlen(statement);
+        memcpy(source + length, statement, statementLength);
+        length += statementLength;
+    }
+
+    source[length] = '\0';
+    source[length + 1] = '\0';
+
+    return newModuleFromSource("bench", source, length);
+}
+
+static double now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+int main()
+{
+    Module* module = generateModule();
+    double best = 0;
+    size_t tokens = 0;
+
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        CompilerContext* context = newCompilerContext();
+        context->module = module;
+        double start = now();
+        TokenBuffer* buffer = scan(context);
+        double elapsed = now() - start;
+        tokens = buffer->size;
+        freeTokenBuffer(buffer);
+        context->module = NULL;
+        freeCompilerContext(context);
+
+        if (best == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    printf("scan: %zu bytes, %zu tokens, %.3f s, %.1f Mtokens/s, %.1f MB/s\n",
+        module->length, tokens, best, tokens / best / 1e6, module->length / best / 1e6);
+    freeModule(module);
+
+    return 0;
+}
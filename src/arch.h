@@ -3,6 +3,7 @@
 
 #include "ir.h"
 
-char* generateAssembly(IR* ir);
+int getRegisterCount();
+char* generateAssembly(CompilerContext* context, IR* ir);
 
 #endif
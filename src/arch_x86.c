@@ -2,29 +2,46 @@
 #include "stringbuilder.h"
 #include "util.h"
 #include "map.h"
+#include "intern.h"
 #include <string.h>
 
 #define REGISTERS_COUNT 4
+#define EAX 0
+#define EDX 3
+#define SCRATCH_SIZE 16
+#define ARGUMENTS_SIZE 8
+#define STACK_ALIGNMENT 16
 #define OPERAND(instruction, index) VECTOR_GET(instruction->operands, index)
 
-char* registers[REGISTERS_COUNT] = {"%eax", "%ebx", "%ecx", "%edx"};
+static char* registers[REGISTERS_COUNT] = {"%eax", "%ebx", "%ecx", "%edx"};
+static char* byteRegisters[REGISTERS_COUNT] = {"%al", "%bl", "%cl", "%dl"};
+static char* wordRegisters[REGISTERS_COUNT] = {"%ax", "%bx", "%cx", "%dx"};
 
 typedef struct {
+    CompilerContext* context;
     int nextLabelNumber;
     StringBuilder* builder;
     Map* procedures;
     bool usedRegisters[REGISTERS_COUNT];
+    int* lastUses;
+    int index;
+    int scratch;
+    StringBuilder* traps;
+    int nextDataNumber;
 } Generator;
 
-Generator* generator;
-
-static Generator* makeGenerator()
+static Generator* makeGenerator(CompilerContext* context, IR* ir)
 {
     Generator* generator = safeMalloc(sizeof(Generator));
+    generator->context = context;
     generator->nextLabelNumber = 0;
     generator->builder = newStringBuilder();
     generator->procedures = newMap();
-    
+    generator->lastUses = NULL;
+    generator->scratch = ir->offset;
+    generator->traps = newStringBuilder();
+    generator->nextDataNumber = 1;
+
     for (int i = 0; i < REGISTERS_COUNT; i++) {
         generator->usedRegisters[i] = false;
     }
@@ -35,26 +52,28 @@ static Generator* makeGenerator()
 static void freeGenerator(Generator* generator)
 {
     freeStringBuilder(generator->builder);
+    freeStringBuilder(generator->traps);
     freeMap(generator->procedures);
+    free(generator->lastUses);
     free(generator);
 }
 
-static char* makeLabel()
+static char* makeLabel(Generator* generator)
 {
     return format("L%d", generator->nextLabelNumber++);
 }
 
-static void emit(char* code)
+static void emit(Generator* generator, char* code)
 {
     appendStringBuilder(generator->builder, code);
 }
 
-static void emitLine(char* line)
+static void emitLine(Generator* generator, char* line)
 {
-    emit(format("    %s\n", line));
+    emit(generator, format("    %s\n", line));
 }
 
-static int getFreeRegister()
+static int getFreeRegister(Generator* generator)
 {
     for (int i = 0; i < REGISTERS_COUNT; i++) {
         if (generator->usedRegisters[i] == false) {
@@ -65,7 +84,12 @@ static int getFreeRegister()
     }
 }
 
-static char* operand(Operand* operand)
+static char* memory(int offset)
+{
+    return format("%d(%%ebp)", -offset - 4);
+}
+
+static char* operand(Generator* generator, Operand* operand)
 {
     switch (operand->type) {
         case OPERAND_INTEGER:
@@ -74,136 +98,491 @@ static char* operand(Operand* operand)
             Register* reg = operand->value.reg;
 
             if (reg->realNumber == -1) {
-                reg->realNumber = getFreeRegister();
+                reg->realNumber = getFreeRegister(generator);
+            }
+
+            switch (operand->width) {
+                case 1:
+                    return byteRegisters[reg->realNumber];
+                case 2:
+                    return wordRegisters[reg->realNumber];
             }
 
             return registers[reg->realNumber];
         }
         case OPERAND_MEMORY:
-            return format("%d(%%esp)", -operand->value.integer - 4);
+            return memory(operand->value.integer);
     }
 }
 
-static void freeRegister(int reg)
+static char suffix(Operand* operand)
+{
+    switch (operand->width) {
+        case 1:
+            return 'b';
+        case 2:
+            return 'w';
+    }
+
+    return 'l';
+}
+
+static void freeRegister(Generator* generator, int reg)
 {
     generator->usedRegisters[reg] = false;
 }
 
-static void freeOperand(Operand* operand)
+// Registers are released by the instruction reading them for the last time,
+// so that a value never read again doesn't hold its register.
+static void freeOperand(Generator* generator, Operand* operand)
 {
     switch (operand->type) {
         case OPERAND_REGISTER:
-            freeRegister(operand->value.reg->realNumber);
+            if (generator->lastUses[operand->value.reg->virtualNumber] == generator->index) {
+                freeRegister(generator, operand->value.reg->realNumber);
+            }
+
             break;
     }
 }
 
-static void binaryOperation(Instruction* instruction, char* operation)
+static bool isInRegister(Operand* operand, int reg)
+{
+    return operand->type == OPERAND_REGISTER && operand->value.reg->realNumber == reg;
+}
+
+// Both operands are released before the result is allocated, so it may take
+// the register of either of them. When it takes the second one's, the
+// operation is reordered instead of overwriting it: shift counts are always
+// immediates and subtracting is adding the negation.
+static void binaryOperation(Generator* generator, Instruction* instruction, char* operation)
 {
     Operand* operand1 = OPERAND(instruction, 0);
     Operand* operand2 = OPERAND(instruction, 1);
+    Operand* result = OPERAND(instruction, 2);
+
+    char* value1 = operand(generator, operand1);
+    char* value2 = operand(generator, operand2);
+    freeOperand(generator, operand1);
+    freeOperand(generator, operand2);
+    char* resultReg = operand(generator, result);
+    int resultNumber = result->value.reg->realNumber;
+
+    if (isInRegister(operand1, resultNumber)) {
+        emitLine(generator, format("%s %s, %s", operation, value2, resultReg));
+    } else if (isInRegister(operand2, resultNumber)) {
+        if (instruction->type == IR_SUBSTRACT) {
+            emitLine(generator, format("negl %s", resultReg));
+            operation = "addl";
+        }
 
-    char* value1 = operand(operand1);
-    char* value2 = operand(operand2);
-    char* resultReg = operand(OPERAND(instruction, 2));
-
-    emitLine(format("movl %s, %s", value2, resultReg));
-    emitLine(format("%s %s, %s", operation, value1, resultReg));
+        emitLine(generator, format("%s %s, %s", operation, value1, resultReg));
+    } else {
+        emitLine(generator, format("movl %s, %s", value1, resultReg));
+        emitLine(generator, format("%s %s, %s", operation, value2, resultReg));
+    }
 
-    freeOperand(operand1);
-    freeOperand(operand2);
+    freeOperand(generator, result);
 }
 
-static void divide(Instruction* instruction)
+// Copies both operands to memory past the variables and releases them, for
+// the operations that need fixed or more registers than they have operands.
+static void stageOperands(Generator* generator, Instruction* instruction)
 {
     Operand* operand1 = OPERAND(instruction, 0);
     Operand* operand2 = OPERAND(instruction, 1);
 
-    char* value1 = operand(operand1);
-    char* value2 = operand(operand2);
-    char* resultReg = operand(OPERAND(instruction, 2));
+    emitLine(generator, format("movl %s, %s", operand(generator, operand1), memory(generator->scratch)));
+    emitLine(generator, format("movl %s, %s", operand(generator, operand2), memory(generator->scratch + 4)));
+    freeOperand(generator, operand1);
+    freeOperand(generator, operand2);
+}
+
+// idivl overwrites %eax and %edx, so the values other than the result living
+// there are saved next to the staged operands.
+static void preserveDivisionRegisters(Generator* generator, int resultNumber, bool restore)
+{
+    int preserved[] = {EAX, EDX};
+
+    for (int i = 0; i < 2; i++) {
+        int reg = preserved[i];
+
+        if (!generator->usedRegisters[reg] || reg == resultNumber) {
+            continue;
+        }
+
+        char* saved = memory(generator->scratch + 8 + i * 4);
+
+        if (restore) {
+            emitLine(generator, format("movl %s, %s", saved, registers[reg]));
+        } else {
+            emitLine(generator, format("movl %s, %s", registers[reg], saved));
+        }
+    }
+}
+
+// Escapes text for .ascii, non-ASCII bytes included.
+static char* escapeAscii(char* text)
+{
+    StringBuilder* builder = newStringBuilder();
+
+    for (unsigned char* c = (unsigned char*) text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            addStringBuilder(builder, '\\');
+            addStringBuilder(builder, *c);
+        } else if (*c == '\n') {
+            appendStringBuilder(builder, "\\n");
+        } else if (*c < 0x20 || *c >= 0x7f) {
+            char* escaped = format("\\%03o", *c);
+            appendStringBuilder(builder, escaped);
+            free(escaped);
+        } else {
+            addStringBuilder(builder, *c);
+        }
+    }
+
+    char* escaped = buildStringBuilder(builder);
+    freeStringBuilder(builder);
+
+    return escaped;
+}
+
+// Adds the code writing the error to stderr like the compiler would report it
+// and leaving main with status 1, where it otherwise returns 0. Traps are
+// emitted after all the procedures, out of the way of the code that doesn't
+// fail, and run in the frame of main where every instruction does. The third
+// argument of write may overwrite a variable, which is never read again.
+static char* addTrap(Generator* generator, Instruction* instruction, char* message)
+{
+    Module* module = generator->context->module;
+    size_t start = instruction->span.startIndex;
+    char* label = makeLabel(generator);
+    char* text = format("[ERROR] %s\n", message);
+
+    if (instruction->span.endIndex > start) {
+        size_t line = getModuleLine(module, start);
+        char* located = format("%s--> %s - %zu:%zu\n", text, module->filename, line, start - getModuleLineStart(module, line) + 1);
+        free(text);
+        text = located;
+    }
+
+    char* escaped = escapeAscii(text);
+    int data = generator->nextDataNumber++;
+    char* trap = format(
+        "%s:\n"
+        "    movl $2, (%%esp)\n"
+        "    movl $D%d, 4(%%esp)\n"
+        "    movl $%zu, 8(%%esp)\n"
+        "    call _write\n"
+        "    movl $1, %%eax\n"
+        "    leave\n"
+        "    ret\n"
+        "D%d: .ascii \"%s\"\n",
+        label, data, strlen(text), data, escaped
+    );
+    appendStringBuilder(generator->traps, trap);
+    free(trap);
+    free(escaped);
+    free(text);
+
+    return label;
+}
+
+// Jumps to a trap when the value is zero, unless the range analysis proved
+// it never is.
+static void checkNonZero(Generator* generator, Instruction* instruction, char* value, char* message)
+{
+    if (!(instruction->checks & CHECK_ZERO)) {
+        return;
+    }
+
+    emitLine(generator, format("cmpl $0, %s", value));
+    emitLine(generator, format("je %s", addTrap(generator, instruction, message)));
+}
+
+// idivl divides %edx:%eax and doesn't take an immediate divisor, so the
+// operands go through memory. When the division is checked for overflow, a
+// -1 divisor negates the dividend instead, which wraps INT_MIN, and gives a
+// zero remainder.
+static void divide(Generator* generator, Instruction* instruction, char* resultSource)
+{
+    Operand* result = OPERAND(instruction, 2);
+    stageOperands(generator, instruction);
+    char* resultReg = operand(generator, result);
+    int resultNumber = result->value.reg->realNumber;
+    char* dividend = memory(generator->scratch);
+    char* divisor = memory(generator->scratch + 4);
+    char* message = instruction->type == IR_DIVIDE ? "Can't divide per zero." : "Can't modulo per zero.";
+    char* general = NULL;
+    char* done = NULL;
+
+    checkNonZero(generator, instruction, divisor, message);
+
+    if (instruction->checks & CHECK_OVERFLOW) {
+        general = makeLabel(generator);
+        done = makeLabel(generator);
+        emitLine(generator, format("cmpl $-1, %s", divisor));
+        emitLine(generator, format("jne %s", general));
+
+        if (instruction->type == IR_DIVIDE) {
+            emitLine(generator, format("movl %s, %s", dividend, resultReg));
+            emitLine(generator, format("negl %s", resultReg));
+        } else {
+            emitLine(generator, format("movl $0, %s", resultReg));
+        }
+
+        emitLine(generator, format("jmp %s", done));
+        emit(generator, format("%s:\n", general));
+    }
+
+    preserveDivisionRegisters(generator, resultNumber, false);
+    emitLine(generator, format("movl %s, %%eax", dividend));
+    emitLine(generator, "cltd");
+    emitLine(generator, format("idivl %s", divisor));
+    emitLine(generator, format("movl %s, %s", resultSource, resultReg));
+    preserveDivisionRegisters(generator, resultNumber, true);
+
+    if (done != NULL) {
+        emit(generator, format("%s:\n", done));
+    }
+
+    freeOperand(generator, result);
+}
+
+// Exponentiation by squaring over the staged base and exponent, which are
+// updated in place. A negative exponent raises 1 / base instead, which traps
+// on a zero base like a division. Squaring needs a second register, whose
+// value is saved when none is free.
+static void power(Generator* generator, Instruction* instruction)
+{
+    Operand* result = OPERAND(instruction, 2);
+    stageOperands(generator, instruction);
+    char* resultReg = operand(generator, result);
+    int resultNumber = result->value.reg->realNumber;
+    char* base = memory(generator->scratch);
+    char* exponent = memory(generator->scratch + 4);
+    char* start = makeLabel(generator);
+    char* loop = makeLabel(generator);
+    char* skip = makeLabel(generator);
+    char* done = makeLabel(generator);
+
+    emitLine(generator, format("cmpl $0, %s", exponent));
+    emitLine(generator, format("jge %s", start));
+    checkNonZero(generator, instruction, base, "Can't raise zero to a negative power.");
+    preserveDivisionRegisters(generator, resultNumber, false);
+    emitLine(generator, "movl $1, %eax");
+    emitLine(generator, "cltd");
+    emitLine(generator, format("idivl %s", base));
+    emitLine(generator, format("movl %%eax, %s", base));
+    preserveDivisionRegisters(generator, resultNumber, true);
+    emitLine(generator, format("negl %s", exponent));
+    emit(generator, format("%s:\n", start));
+
+    int square = resultNumber == 0 ? 1 : 0;
+    bool saveSquare = true;
+
+    for (int reg = 0; reg < REGISTERS_COUNT; reg++) {
+        if (!generator->usedRegisters[reg]) {
+            square = reg;
+            saveSquare = false;
+            break;
+        }
+    }
+
+    char* squareReg = registers[square];
+    char* saved = memory(generator->scratch + 8);
+
+    if (saveSquare) {
+        emitLine(generator, format("movl %s, %s", squareReg, saved));
+    }
 
-    emitLine(format("movl %s, %%eax", value1));
-    emitLine(format("movl %s, %%ebx", value2));
-    emitLine(format("idivl %%ebx", value2));
-    emitLine(format("movl %%eax, %s", resultReg));
+    emitLine(generator, format("movl $1, %s", resultReg));
+    emit(generator, format("%s:\n", loop));
+    emitLine(generator, format("cmpl $0, %s", exponent));
+    emitLine(generator, format("je %s", done));
+    emitLine(generator, format("testl $1, %s", exponent));
+    emitLine(generator, format("je %s", skip));
+    emitLine(generator, format("imull %s, %s", base, resultReg));
+    emit(generator, format("%s:\n", skip));
+    emitLine(generator, format("movl %s, %s", base, squareReg));
+    emitLine(generator, format("imull %s, %s", squareReg, squareReg));
+    emitLine(generator, format("movl %s, %s", squareReg, base));
+    emitLine(generator, format("shrl $1, %s", exponent));
+    emitLine(generator, format("jmp %s", loop));
+    emit(generator, format("%s:\n", done));
+
+    if (saveSquare) {
+        emitLine(generator, format("movl %s, %s", saved, squareReg));
+    }
 
-    freeOperand(operand1);
-    freeOperand(operand2);
+    freeOperand(generator, result);
 }
 
-static void move(Instruction* instruction)
+static void negate(Generator* generator, Instruction* instruction)
 {
     Operand* source = OPERAND(instruction, 0);
-    char* destination = operand(OPERAND(instruction, 1));
-    emitLine(format("movl %s, %s", operand(source), destination));
-    freeOperand(source);
+    Operand* result = OPERAND(instruction, 1);
+    char* value = operand(generator, source);
+    freeOperand(generator, source);
+    char* resultReg = operand(generator, result);
+
+    emitLine(generator, format("movl %s, %s", value, resultReg));
+    emitLine(generator, format("negl %s", resultReg));
+    freeOperand(generator, result);
 }
 
-static void ret(Instruction* instruction)
+static void move(Generator* generator, Instruction* instruction)
 {
-    char* source = operand(OPERAND(instruction, 0));
-    emitLine(format("movl %s, %%eax", source));
-    emitLine("movl $D0, (%esp)");
-    emitLine("movl %eax, 4(%esp)");
-    emitLine("call _printf");
-    emitLine("leave");
-    emitLine("ret");
+    Operand* source = OPERAND(instruction, 0);
+    Operand* destination = OPERAND(instruction, 1);
+    char* value = operand(generator, source);
+    freeOperand(generator, source);
+    char* target = operand(generator, destination);
+    emitLine(generator, format("mov%c %s, %s", suffix(destination), value, target));
+    freeOperand(generator, destination);
 }
 
-static void instruction(Instruction* instruction)
+static void ret(Generator* generator, Instruction* instruction)
+{
+    Operand* source = OPERAND(instruction, 0);
+    char* value = operand(generator, source);
+
+    if (source->width < 4 && source->type != OPERAND_INTEGER) {
+        emitLine(generator, format("movz%cl %s, %%eax", suffix(source), value));
+    } else if (!isInRegister(source, EAX)) {
+        emitLine(generator, format("movl %s, %%eax", value));
+    }
+
+    emitLine(generator, "movl $D0, (%esp)");
+    emitLine(generator, "movl %eax, 4(%esp)");
+    emitLine(generator, "call _printf");
+    emitLine(generator, "movl $0, %eax");
+    emitLine(generator, "leave");
+    emitLine(generator, "ret");
+}
+
+static void instruction(Generator* generator, Instruction* instruction)
 {
     switch (instruction->type) {
         case IR_ADD:
-            binaryOperation(instruction, "addl");
+            binaryOperation(generator, instruction, "addl");
             break;
         case IR_SUBSTRACT:
-            binaryOperation(instruction, "subl");
+            binaryOperation(generator, instruction, "subl");
             break;
         case IR_MULTIPLY:
-            binaryOperation(instruction, "imull");
+            binaryOperation(generator, instruction, "imull");
             break;
         case IR_DIVIDE:
-            divide(instruction);
+            divide(generator, instruction, "%eax");
             break;
         case IR_MODULO:
+            divide(generator, instruction, "%edx");
+            break;
+        case IR_NEGATE:
+            negate(generator, instruction);
+            break;
+        case IR_POWER:
+            power(generator, instruction);
+            break;
+        case IR_SHIFT_LEFT:
+            binaryOperation(generator, instruction, "sall");
+            break;
+        case IR_SHIFT_RIGHT:
+            binaryOperation(generator, instruction, "sarl");
+            break;
+        case IR_SHIFT_RIGHT_LOGICAL:
+            binaryOperation(generator, instruction, "shrl");
+            break;
+        case IR_AND:
+            binaryOperation(generator, instruction, "andl");
             break;
         case IR_MOVE:
-            move(instruction);
+            move(generator, instruction);
             break;
         case IR_RETURN:
-            ret(instruction);
+            ret(generator, instruction);
             break; 
     }
 }
 
-static void procedure(Procedure* procedure)
+static void procedure(Generator* generator, Procedure* procedure)
 {
-    char* label = makeLabel();
-    setMap(generator->procedures, procedure->name, label);
-    emit(format("%s:\n", label));
+    char* label = makeLabel(generator);
+    setMap(generator->procedures, internIdentifier(generator->context->identifiers, procedure->name, strlen(procedure->name)), label);
+    emit(generator, format("%s:\n", label));
+    generator->lastUses = safeRealloc(generator->lastUses, sizeof(int) * (procedure->nextRegisterNumber + 1));
 
     for (VECTOR_EACH(procedure->instructions)) {
-        instruction(VECTOR_GET(procedure->instructions, i));
+        Instruction* current = VECTOR_GET(procedure->instructions, i);
+
+        for (int j = 0; j < VECTOR_SIZE(current->operands); j++) {
+            Operand* operand = VECTOR_GET(current->operands, j);
+
+            if (operand->type == OPERAND_REGISTER) {
+                generator->lastUses[operand->value.reg->virtualNumber] = i;
+            }
+        }
+    }
+
+    for (VECTOR_EACH(procedure->instructions)) {
+        generator->index = i;
+        instruction(generator, VECTOR_GET(procedure->instructions, i));
+    }
+}
+
+int getRegisterCount()
+{
+    return REGISTERS_COUNT;
+}
+
+// The frame holds the variables, then the scratch slots when an operation
+// is staged in memory, and the arguments of printf at its bottom.
+static int getFrameSize(IR* ir)
+{
+    int size = ir->offset + ARGUMENTS_SIZE;
+    bool staged = false;
+
+    for (VECTOR_EACH(ir->procedures)) {
+        Procedure* procedure = VECTOR_GET(ir->procedures, i);
+
+        for (int j = 0; j < VECTOR_SIZE(procedure->instructions); j++) {
+            switch (((Instruction*) VECTOR_GET(procedure->instructions, j))->type) {
+                case IR_DIVIDE:
+                case IR_MODULO:
+                case IR_POWER:
+                    staged = true;
+                    break;
+            }
+        }
     }
+
+    if (staged) {
+        size += SCRATCH_SIZE;
+    }
+
+    return (size + STACK_ALIGNMENT - 1) / STACK_ALIGNMENT * STACK_ALIGNMENT;
 }
 
-char* generateAssembly(IR* ir)
+char* generateAssembly(CompilerContext* context, IR* ir)
 {
-    generator = makeGenerator();
-    emit(
+    Generator* generator = makeGenerator(context, ir);
+    emit(generator,
         "    .globl _main\n"
         "D0: .ascii \"%d\\0\"\n"
         "_main:\n"
         "    pushl %ebp\n"
         "    movl %esp, %ebp\n"
-        "    subl $32, %esp\n"
     );
+    emitLine(generator, format("subl $%d, %%esp", getFrameSize(ir)));
 
     for (VECTOR_EACH(ir->procedures)) {
-        procedure(VECTOR_GET(ir->procedures, i));
+        procedure(generator, VECTOR_GET(ir->procedures, i));
     }
 
+    char* traps = buildStringBuilder(generator->traps);
+    emit(generator, traps);
+    free(traps);
     char* code = buildStringBuilder(generator->builder);
     freeGenerator(generator);
 
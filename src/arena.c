@@ -0,0 +1,72 @@
+#include "arena.h"
+#include "util.h"
+#include <stdint.h>
+
+#define ARENA_BLOCK_SIZE 65536
+#define ARENA_ALIGNMENT 16
+
+static ArenaBlock* newArenaBlock(ArenaBlock* previous, size_t capacity)
+{
+    ArenaBlock* block = safeMalloc(sizeof(ArenaBlock) + capacity);
+    block->previous = previous;
+    block->used = 0;
+    block->capacity = capacity;
+
+    return block;
+}
+
+Arena* newArena()
+{
+    Arena* arena = safeMalloc(sizeof(Arena));
+    arena->blocks = newArenaBlock(NULL, ARENA_BLOCK_SIZE);
+
+    return arena;
+}
+
+static size_t alignBlockOffset(ArenaBlock* block)
+{
+    uintptr_t address = (uintptr_t) (block->data + block->used);
+    uintptr_t aligned = (address + ARENA_ALIGNMENT - 1) & ~(uintptr_t) (ARENA_ALIGNMENT - 1);
+
+    return block->used + (aligned - address);
+}
+
+void* allocateArena(Arena* arena, size_t size)
+{
+    ArenaBlock* block = arena->blocks;
+    size_t offset = alignBlockOffset(block);
+
+    if (offset + size > block->capacity) {
+        size_t capacity = size + ARENA_ALIGNMENT > ARENA_BLOCK_SIZE ? size + ARENA_ALIGNMENT : ARENA_BLOCK_SIZE;
+        block = newArenaBlock(block, capacity);
+        arena->blocks = block;
+        offset = alignBlockOffset(block);
+    }
+
+    block->used = offset + size;
+
+    return block->data + offset;
+}
+
+// Keeps the most recent block so that the arena can be reused without
+// going back to malloc.
+void resetArena(Arena* arena)
+{
+    ArenaBlock* block = arena->blocks->previous;
+
+    while (block != NULL) {
+        ArenaBlock* previous = block->previous;
+        free(block);
+        block = previous;
+    }
+
+    arena->blocks->previous = NULL;
+    arena->blocks->used = 0;
+}
+
+void freeArena(Arena* arena)
+{
+    resetArena(arena);
+    free(arena->blocks);
+    free(arena);
+}
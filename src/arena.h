@@ -0,0 +1,22 @@
+#ifndef OPAL_ARENA_H
+#define OPAL_ARENA_H
+
+#include <stddef.h>
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* previous;
+    size_t used;
+    size_t capacity;
+    char data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock* blocks;
+} Arena;
+
+Arena* newArena();
+void* allocateArena(Arena* arena, size_t size);
+void resetArena(Arena* arena);
+void freeArena(Arena* arena);
+
+#endif
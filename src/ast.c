@@ -0,0 +1,89 @@
+#include "ast.h"
+#include "util.h"
+#include <string.h>
+
+static void allocateNodes(Ast* ast, uint32_t capacity)
+{
+    uint8_t* types = allocateArena(ast->arena, sizeof(uint8_t) * capacity);
+    TypeId* valueTypes = allocateArena(ast->arena, sizeof(TypeId) * capacity);
+    NodeIndex* left = allocateArena(ast->arena, sizeof(NodeIndex) * capacity);
+    NodeIndex* right = allocateArena(ast->arena, sizeof(NodeIndex) * capacity);
+    int* values = allocateArena(ast->arena, sizeof(int) * capacity);
+    bool* simplified = allocateArena(ast->arena, sizeof(bool) * capacity);
+    Span* spans = allocateArena(ast->arena, sizeof(Span) * capacity);
+
+    if (ast->size > 0) {
+        memcpy(types, ast->types, sizeof(uint8_t) * ast->size);
+        memcpy(valueTypes, ast->valueTypes, sizeof(TypeId) * ast->size);
+        memcpy(left, ast->left, sizeof(NodeIndex) * ast->size);
+        memcpy(right, ast->right, sizeof(NodeIndex) * ast->size);
+        memcpy(values, ast->values, sizeof(int) * ast->size);
+        memcpy(simplified, ast->simplified, sizeof(bool) * ast->size);
+        memcpy(spans, ast->spans, sizeof(Span) * ast->size);
+    }
+
+    ast->types = types;
+    ast->valueTypes = valueTypes;
+    ast->left = left;
+    ast->right = right;
+    ast->values = values;
+    ast->simplified = simplified;
+    ast->spans = spans;
+    ast->capacity = capacity;
+}
+
+// The columns live in the arena: when they grow, the previous copies stay
+// there until the arena is reset.
+Ast* newAst(Arena* arena, uint32_t capacity)
+{
+    Ast* ast = allocateArena(arena, sizeof(Ast));
+    ast->arena = arena;
+    ast->size = 0;
+    ast->lists = NULL;
+    ast->listSize = 0;
+    ast->listCapacity = 0;
+    ast->root = NODE_NONE;
+    allocateNodes(ast, capacity > 0 ? capacity : 1);
+
+    return ast;
+}
+
+NodeIndex addAstNode(Ast* ast, NodeType type, size_t startIndex, size_t endIndex)
+{
+    if (ast->size == ast->capacity) {
+        allocateNodes(ast, ast->capacity * 2);
+    }
+
+    NodeIndex node = ast->size++;
+    ast->types[node] = type;
+    ast->valueTypes[node] = TYPE_NONE;
+    ast->left[node] = NODE_NONE;
+    ast->right[node] = NODE_NONE;
+    ast->values[node] = 0;
+    ast->simplified[node] = false;
+    ast->spans[node].startIndex = startIndex;
+    ast->spans[node].endIndex = endIndex;
+
+    return node;
+}
+
+uint32_t addAstList(Ast* ast, NodeIndex* items, uint32_t count)
+{
+    if (ast->listSize + count > ast->listCapacity) {
+        uint32_t capacity = ast->listCapacity * 2 > ast->listSize + count ? ast->listCapacity * 2 : ast->listSize + count;
+        NodeIndex* lists = allocateArena(ast->arena, sizeof(NodeIndex) * capacity);
+
+        if (ast->listSize > 0) {
+            memcpy(lists, ast->lists, sizeof(NodeIndex) * ast->listSize);
+        }
+
+        ast->lists = lists;
+        ast->listCapacity = capacity;
+    }
+
+    uint32_t start = ast->listSize;
+    memcpy(ast->lists + start, items, sizeof(NodeIndex) * count);
+    ast->listSize += count;
+
+    return start;
+}
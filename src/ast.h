@@ -0,0 +1,78 @@
+#ifndef OPAL_AST_H
+#define OPAL_AST_H
+
+#include "arena.h"
+#include "type.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NODE_NONE UINT32_MAX
+
+typedef uint32_t NodeIndex;
+
+typedef enum {
+    // STRUCTS
+    NODE_STATEMENTS,
+    NODE_ASSIGNMENT,
+    NODE_LOAD,
+
+    // INSTRUCTIONS
+    NODE_ADD,
+    NODE_SUBSTRACT,
+    NODE_MULTIPLY,
+    NODE_DIVIDE,
+    NODE_MODULO,
+    NODE_NEGATE,
+    NODE_POWER,
+
+    // VALUES
+    NODE_INTEGER,
+    NODE_BOOLEAN,
+    NODE_NULL,
+
+    // OTHERS
+    NODE_FOLDED
+} NodeType;
+
+typedef struct {
+    size_t startIndex;
+    size_t endIndex;
+} Span;
+
+// Nodes are stored column by column and are appended in post-order, so a
+// node's children always have smaller indices than the node itself and
+// the root is the last node. What left, right and value hold depends on
+// the node type:
+//   binary operations   left and right operands
+//   NODE_NEGATE         left operand
+//   NODE_INTEGER        value
+//   NODE_BOOLEAN        value (0 or 1)
+//   NODE_ASSIGNMENT     left initializer (or NODE_NONE), value identifier
+//   NODE_LOAD           left declaring assignment, value identifier
+//   NODE_STATEMENTS     left first index in lists, right statement count
+// A NODE_FOLDED node was merged into its parent by constant folding.
+// Simplified integers depend on an identity like x - x = 0, which only
+// -O1 applies, so they aren't reported as a zero divisor.
+typedef struct {
+    uint8_t* types;
+    TypeId* valueTypes;
+    NodeIndex* left;
+    NodeIndex* right;
+    int* values;
+    bool* simplified;
+    Span* spans;
+    uint32_t size;
+    uint32_t capacity;
+    NodeIndex* lists;
+    uint32_t listSize;
+    uint32_t listCapacity;
+    NodeIndex root;
+    Arena* arena;
+} Ast;
+
+Ast* newAst(Arena* arena, uint32_t capacity);
+NodeIndex addAstNode(Ast* ast, NodeType type, size_t startIndex, size_t endIndex);
+uint32_t addAstList(Ast* ast, NodeIndex* items, uint32_t count);
+
+#endif
@@ -0,0 +1,43 @@
+#include "context.h"
+#include "util.h"
+#include "error.h"
+#include "remark.h"
+#include <stdlib.h>
+
+CompilerContext* newCompilerContext()
+{
+    CompilerContext* context = safeMalloc(sizeof(CompilerContext));
+    context->module = NULL;
+    context->errors = newVector();
+    context->arena = newArena();
+    context->identifiers = newInternTable();
+    context->types = newTypeTable();
+    context->maxNestingDepth = DEFAULT_MAX_NESTING_DEPTH;
+    context->optimizationLevel = DEFAULT_OPTIMIZATION_LEVEL;
+    context->remarks = newVector();
+    context->remarkKinds = 0;
+
+    return context;
+}
+
+void freeCompilerContext(CompilerContext* context)
+{
+    for (VECTOR_EACH(context->errors)) {
+        freeError(VECTOR_GET(context->errors, i));
+    }
+
+    for (VECTOR_EACH(context->remarks)) {
+        freeRemark(VECTOR_GET(context->remarks, i));
+    }
+
+    if (context->module != NULL) {
+        freeModule(context->module);
+    }
+
+    freeVector(context->errors);
+    freeVector(context->remarks);
+    freeArena(context->arena);
+    freeInternTable(context->identifiers);
+    freeTypeTable(context->types);
+    free(context);
+}
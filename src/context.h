@@ -0,0 +1,31 @@
+#ifndef OPAL_CONTEXT_H
+#define OPAL_CONTEXT_H
+
+#include "module.h"
+#include "vector.h"
+#include "arena.h"
+#include "intern.h"
+#include "type.h"
+
+#define DEFAULT_MAX_NESTING_DEPTH 65536
+#define DEFAULT_OPTIMIZATION_LEVEL 2
+
+// Everything a compilation owns. Nothing in the pipeline keeps mutable
+// global state, so modules compiled through different contexts can run on
+// different threads at the same time.
+typedef struct CompilerContext {
+    Module* module;
+    Vector* errors;
+    Arena* arena;
+    InternTable* identifiers;
+    TypeTable* types;
+    int maxNestingDepth;
+    int optimizationLevel;
+    Vector* remarks;
+    int remarkKinds;
+} CompilerContext;
+
+CompilerContext* newCompilerContext();
+void freeCompilerContext(CompilerContext* context);
+
+#endif
@@ -1,14 +1,14 @@
 #include "debug.h"
 #include "scan.h"
 #include <stdio.h>
-#include <math.h>
 #include "map.h"
 #include "util.h"
+#include "intern.h"
 
-void debugTokens(Vector* tokens)
+void debugTokens(CompilerContext* context, TokenBuffer* tokens)
 {
-    for (VECTOR_EACH(tokens)) {
-        Token* token = VECTOR_GET(tokens, i);
+    for (int i = 0; i < tokens->size; i++) {
+        Token* token = &tokens->tokens[i];
 
         switch (token->type) {
             case TOKEN_PLUS:
@@ -39,7 +39,7 @@ void debugTokens(Vector* tokens)
                 printf("SEMILICON\n");
                 break;
             case TOKEN_INTEGER:
-                printf("INTEGER | %d\n", token->value.integer);
+                printf("INTEGER | %lld\n", (long long) token->value.integer);
                 break;
             case TOKEN_EOF:
                 printf("EOF\n");
@@ -48,7 +48,7 @@ void debugTokens(Vector* tokens)
                 printf("CONST\n");
                 break;
             case TOKEN_IDENTIFIER:
-                printf("IDENTIFIER | %s\n", token->value.string);
+                printf("IDENTIFIER | %s\n", getIdentifierName(context->identifiers, token->value.identifier));
                 break;
             case TOKEN_EQUAL:
                 printf("EQUAL\n");
@@ -59,48 +59,56 @@ void debugTokens(Vector* tokens)
     }
 }
 
-int interpretNode(Node* node)
+// Nodes are stored in post-order, so evaluating every node up to the
+// requested one in index order computes the operands before their parent.
+int interpretNode(Ast* ast, NodeIndex node)
 {
-    int value;
-
-    #define COMBINE(node, operator) interpretNode(node->children.left) operator interpretNode(node->children.right)
-    switch (node->type) {
-        case NODE_ADD:
-            value = COMBINE(node, +);
-            break;
-        case NODE_SUBSTRACT:
-            value = COMBINE(node, -);
-            break;
-        case NODE_MULTIPLY:
-            value = COMBINE(node, *);
-            break;
-        case NODE_DIVIDE:
-            value = COMBINE(node, /);
-            break;
-        case NODE_MODULO:
-            value = COMBINE(node, %);
-            break;
-        case NODE_POWER:
-            value = pow(interpretNode(node->children.left), interpretNode(node->children.right));
-            break;
-        case NODE_INTEGER:
-            value = node->children.integer;
-            break;
-        case NODE_NEGATE:
-            value = -node->children.node->children.integer;
-            break;
+    int* values = safeMalloc(sizeof(int) * (node + 1));
+
+    for (NodeIndex index = 0; index <= node; index++) {
+        int value = 0;
+
+        #define LEFT values[ast->left[index]]
+        #define RIGHT values[ast->right[index]]
+        switch (ast->types[index]) {
+            case NODE_ADD:
+                value = LEFT + RIGHT;
+                break;
+            case NODE_SUBSTRACT:
+                value = LEFT - RIGHT;
+                break;
+            case NODE_MULTIPLY:
+                value = LEFT * RIGHT;
+                break;
+            case NODE_DIVIDE:
+                value = RIGHT ? LEFT / RIGHT : 0;
+                break;
+            case NODE_MODULO:
+                value = RIGHT ? LEFT % RIGHT : 0;
+                break;
+            case NODE_POWER:
+                value = LEFT || RIGHT >= 0 ? raiseInteger(LEFT, RIGHT) : 0;
+                break;
+            case NODE_INTEGER:
+                value = ast->values[index];
+                break;
+            case NODE_NEGATE:
+                value = -LEFT;
+                break;
+        }
+        #undef LEFT
+        #undef RIGHT
+
+        values[index] = value;
     }
-    #undef COMBINE
+
+    int value = values[node];
+    free(values);
 
     return value;
 }
 
-#define REGISTER_NUMBER(reg) format("%d", reg->virtualNumber)
-
-Procedure* procedure;
-Map* registers;
-
-static int loadOperand(Instruction* instruction, int index)
+static int loadOperand(Map* registers, Instruction* instruction, int index)
 {
     Operand* operand = VECTOR_GET(instruction->operands, index);
 
@@ -108,17 +116,17 @@ static int loadOperand(Instruction* instruction, int index)
         case OPERAND_INTEGER:
             return operand->value.integer;
         case OPERAND_REGISTER: {
-            return *((int*) getMap(registers, REGISTER_NUMBER(operand->value.reg)));
+            return *((int*) getMap(registers, operand->value.reg->virtualNumber));
         }
     }
 }
 
-static void storeOperand(Instruction* instruction, int index, int value)
+static void storeOperand(Map* registers, Instruction* instruction, int index, int value)
 {
     Operand* operand = VECTOR_GET(instruction->operands, index);
     int* pointer = safeMalloc(sizeof(int));
     *pointer = value;
-    setMap(registers, REGISTER_NUMBER(operand->value.reg), pointer);
+    setMap(registers, operand->value.reg->virtualNumber, pointer);
 }
 
 static void binaryOperation(Instruction* instruction)
@@ -128,13 +136,13 @@ static void binaryOperation(Instruction* instruction)
     }
 }
 
-static void interpretProcedure()
+static void interpretProcedure(Map* registers, Procedure* procedure)
 {
     for (VECTOR_EACH(procedure->instructions)) {
         Instruction* instruction = VECTOR_GET(procedure->instructions, i);
         
         switch (instruction->type) {
-            #define STORE(operator) storeOperand(instruction, 2, loadOperand(instruction, 0) operator loadOperand(instruction, 1))
+            #define STORE(operator) storeOperand(registers, instruction, 2, loadOperand(registers, instruction, 0) operator loadOperand(registers, instruction, 1))
             case IR_ADD:
                 STORE(+);
                 break;
@@ -152,13 +160,20 @@ static void interpretProcedure()
                 break;
             #undef STORE
 
+            case IR_POWER: {
+                int base = loadOperand(registers, instruction, 0);
+                int exponent = loadOperand(registers, instruction, 1);
+                storeOperand(registers, instruction, 2, base || exponent >= 0 ? raiseInteger(base, exponent) : 0);
+                break;
+            }
+
             case IR_RETURN: {
-                printf("%d", loadOperand(instruction, 0));
+                printf("%d", loadOperand(registers, instruction, 0));
                 break;
             }
             case IR_MOVE: {
-                int value = loadOperand(instruction, 0);
-                storeOperand(instruction, 1, value);
+                int value = loadOperand(registers, instruction, 0);
+                storeOperand(registers, instruction, 1, value);
                 break;
             }
         }
@@ -167,9 +182,8 @@ static void interpretProcedure()
 
 void interpretIR(IR* ir)
 {
-    registers = newMap();
-    procedure = VECTOR_GET(ir->procedures, 0);
-    interpretProcedure();
+    Map* registers = newMap();
+    interpretProcedure(registers, VECTOR_GET(ir->procedures, 0));
 
     freeMap(registers);
 }
@@ -4,9 +4,10 @@
 #include "vector.h"
 #include "parse.h"
 #include "ir.h"
+#include "scan.h"
 
-void debugTokens(Vector* tokens);
-int interpretNode(Node* node);
+void debugTokens(CompilerContext* context, TokenBuffer* tokens);
+int interpretNode(Ast* ast, NodeIndex node);
 void interpretIR(IR* ir);
 
 #endif
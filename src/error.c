@@ -7,206 +7,176 @@
 #include "util.h"
 #include <string.h>
 
-Vector* errors;
-
+// A failed allocation can't be recovered from halfway through a stage, so
+// this is the only error that ends the process outside of main.
 void throwFailedAlloc()
 {
-    throwFatal("Failed to allocate memory.");
+    fprintf(stderr, "[FATAL] Failed to allocate memory.\n");
+    abort();
 }
 
-void throwFatal(char* message, ...)
+static Error* newError(char* message, bool located, size_t startIndex, size_t endIndex)
 {
-    va_list args;
-    va_start(args, message);
-    fprintf(stderr, "[FATAL] ");
-    vfprintf(stderr, message, args);
-    fprintf(stderr, "\n");
-    va_end(args);
-    exit(2);
+    Error* error = safeMalloc(sizeof(Error));
+    error->message = message;
+    error->located = located;
+    error->startIndex = startIndex;
+    error->endIndex = endIndex;
+
+    return error;
 }
 
-static void addErrorNotFormat(char* message)
+void freeError(Error* error)
 {
-    if (errors == NULL) {
-        errors = newVector();
-    }
-
-    pushVector(errors, message);
+    free(error->message);
+    free(error);
 }
 
-void addError(char* message, ...)
+void addError(CompilerContext* context, char* message, ...)
 {
-    char buffer[2048];
     va_list args;
     va_start(args, message);
-    vsprintf(buffer, message, args);
+    pushVector(context->errors, newError(formatArguments(message, args), false, 0, 0));
     va_end(args);
-    addErrorNotFormat(buffer);
 }
 
-void throwErrors()
+void reportErrors(CompilerContext* context)
 {
+    Vector* errors = context->errors;
     fprintf(stderr, "%d error%s occured.\n\n", VECTOR_SIZE(errors), VECTOR_SIZE(errors) > 1 ? "s have" : " has");
 
     for (VECTOR_EACH(errors)) {
+        char* text = renderError(context, VECTOR_GET(errors, i));
         fprintf(stderr, "[ERROR] ");
-        fprintf(stderr, "%s", VECTOR_GET(errors, i));
+        fprintf(stderr, "%s", text);
         fprintf(stderr, "\n");
+        free(text);
     }
-
-    exit(1);
 }
 
-void addErrorAt(Module* module, int startIndex, int endIndex, char* message, ...)
+static char* getLineText(Module* module, size_t line)
 {
-    char formattedMessage[2048];
-    va_list args;
-    va_start(args, message);
-    vsprintf(formattedMessage, message, args);
-    va_end(args);
-    
     StringBuilder* builder = newStringBuilder();
-    appendStringBuilder(builder, formattedMessage);
-
-    const char* source = module->source;
-    int index = 0;
-    int startLine = 0;
-    int startColumn = 0;
-    int endLine = 0;
-    int endColumn = 0;
-    int lineIndex = 1;
-    int columnIndex = 1;
-    Vector* lines = newVector();
-    StringBuilder* line = newStringBuilder();
-
-    while (true) {
-        if (index == startIndex) {
-            break;
-        }
-
-        char c = source[index++];
-        columnIndex++;
+    char* source = module->source;
+    size_t end = getModuleLineEnd(module, line);
 
-        if (c == '\n') {
-            lineIndex++;
-            columnIndex = 1;
-            clearStringBuilder(line);
-        }
-
-        if (c == '\0') {
-            freeVector(lines);
-            freeStringBuilder(line);
-            addError(buildStringBuilder(builder));
-            freeStringBuilder(builder);
-
-            return;
-        }
-
-        if (isWhitespace(c) && c != ' ') {
+    for (size_t index = getModuleLineStart(module, line); index < end; index++) {
+        if (isWhitespace(source[index]) && source[index] != ' ') {
             continue;
         }
 
-        addStringBuilder(line, c);
+        addStringBuilder(builder, source[index]);
     }
-    
-    startLine = lineIndex;
-    startColumn = columnIndex;
-    bool end = false;
-
-    while (true) {
-        if (index == endIndex) {
-            break;
-        }
 
-        char c = source[index++];
-        columnIndex++;
-
-        if (c == '\n') {
-            lineIndex++;
-            columnIndex = 1;
-            pushVector(lines, line);
-            line = newStringBuilder();
-        }
+    char* text = buildStringBuilder(builder);
+    freeStringBuilder(builder);
 
-        if (c == '\0') {
-            pushVector(lines, line);
-            end = true;
+    return text;
+}
 
-            break;
-        }
+void addErrorAt(CompilerContext* context, size_t startIndex, size_t endIndex, char* message, ...)
+{
+    va_list args;
+    va_start(args, message);
+    pushVector(context->errors, newError(formatArguments(message, args), true, startIndex, endIndex));
+    va_end(args);
+}
 
-        if (isWhitespace(c) && c != ' ') {
-            continue;
-        }
+static void appendFormat(StringBuilder* builder, char* message, ...)
+{
+    va_list args;
+    va_start(args, message);
+    char* text = formatArguments(message, args);
+    va_end(args);
+    appendStringBuilder(builder, text);
+    free(text);
+}
 
-        addStringBuilder(line, c);
+static void appendRepeated(StringBuilder* builder, char* string, int times)
+{
+    for (int i = 0; i < times; i++) {
+        appendStringBuilder(builder, string);
     }
+}
 
-    endLine = lineIndex;
-    endColumn = columnIndex;
-    
-    if (!end) {
-        while (true) {
-            char c = source[index++];
-            columnIndex++;
-
-            if (c == '\n' || c == '\0') {
-                pushVector(lines, line);
+// Errors keep their position instead of the rendered text, so they can be
+// moved when the source is edited and are only rendered when reported.
+char* renderError(CompilerContext* context, Error* error)
+{
+    Module* module = context->module;
+    size_t startIndex = error->startIndex;
+    size_t endIndex = error->endIndex;
+    StringBuilder* builder = newStringBuilder();
+    appendStringBuilder(builder, error->message);
 
-                break;
-            }
+    if (!error->located || startIndex > module->length) {
+        char* text = buildStringBuilder(builder);
+        freeStringBuilder(builder);
 
-            if (isWhitespace(c) && c != ' ') {
-                continue;
-            }
+        return text;
+    }
 
-            addStringBuilder(line, c);
-        }
+    if (endIndex > module->length + 1) {
+        endIndex = module->length + 1;
     }
 
-    appendStringBuilder(builder, format("\n--> %s - %d:%d\n", module->filename, startLine, startColumn));
-    int maxLineLength = strlen(format("%d", endLine));
-    char* lineFormat = format("%%%dd | %%s\n%s | ", maxLineLength, repeatString(" ", maxLineLength));
-    bool hasCut = false;
+    size_t startLine = getModuleLine(module, startIndex);
+    size_t startColumn = startIndex - getModuleLineStart(module, startLine) + 1;
+    size_t endLine = getModuleLine(module, endIndex);
+    size_t endColumn = endIndex - getModuleLineStart(module, endLine) + 1;
 
-    for (VECTOR_EACH(lines)) {
-        StringBuilder* lineBuilder = VECTOR_GET(lines, i);
-        char* line = buildStringBuilder(lineBuilder);
+    appendFormat(builder, "\n--> %s - %zu:%zu\n", module->filename, startLine, startColumn);
+    char* endLineText = format("%zu", endLine);
+    int maxLineLength = strlen(endLineText);
+    char* padding = repeatString(" ", maxLineLength);
+    char* lineFormat = format("%%%dzu | %%s\n%s | ", maxLineLength, padding);
+    bool hasCut = false;
+    free(endLineText);
+    free(padding);
 
-        if (!strlen(line)) {
+    for (size_t lineNumber = startLine; lineNumber <= endLine; lineNumber++) {
+        char* line = getLineText(module, lineNumber);
+        int lineLength = strlen(line);
 
+        if (!lineLength) {
             if (!hasCut) {
                 hasCut = true;
-                appendStringBuilder(builder, format("%s\n", repeatString("-", maxLineLength + 7)));
-                freeStringBuilder(lineBuilder);
+                appendRepeated(builder, "-", maxLineLength + 7);
+                addStringBuilder(builder, '\n');
             }
 
+            free(line);
+
             continue;
         }
 
         hasCut = false;
-        int lineNumber = startLine + i;
-        appendStringBuilder(builder, format(lineFormat, lineNumber, line));
+        appendFormat(builder, lineFormat, lineNumber, line);
 
         if (lineNumber == startLine && lineNumber == endLine) {
-            appendStringBuilder(builder, format("%s%s\n", repeatString(" ", startColumn - 1), repeatString("^", endColumn - startColumn)));
+            appendRepeated(builder, " ", startColumn - 1);
+            appendRepeated(builder, "^", endColumn - startColumn);
         } else if (lineNumber == startLine) {
-            appendStringBuilder(builder, format("%s%s\n", repeatString(" ", startColumn - 1), repeatString("^", strlen(line) - startColumn + 1)));
+            appendRepeated(builder, " ", startColumn - 1);
+            appendRepeated(builder, "^", lineLength - (int) startColumn + 1);
         } else if (lineNumber == endLine) {
-            appendStringBuilder(builder, format("%s\n", repeatString("^", endColumn - 1)));
+            appendRepeated(builder, "^", endColumn - 1);
         } else {
-            appendStringBuilder(builder, format("%s\n", repeatString("^", strlen(line))));
+            appendRepeated(builder, "^", lineLength);
         }
 
-        freeStringBuilder(lineBuilder);
+        addStringBuilder(builder, '\n');
+        free(line);
     }
 
-    freeVector(lines);
-    addErrorNotFormat(buildStringBuilder(builder));
+    free(lineFormat);
+    char* text = buildStringBuilder(builder);
     freeStringBuilder(builder);
+
+    return text;
 }
 
-bool hasErrors()
+bool hasErrors(CompilerContext* context)
 {
-    return errors != NULL && VECTOR_SIZE(errors);
+    return VECTOR_SIZE(context->errors);
 }
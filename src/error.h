@@ -1,14 +1,22 @@
 #ifndef OPAL_ERROR_H
 #define OPAL_ERROR_H
 
-#include "module.h"
+#include "context.h"
 #include <stdbool.h>
 
+typedef struct {
+    char* message;
+    bool located;
+    size_t startIndex;
+    size_t endIndex;
+} Error;
+
 void throwFailedAlloc();
-void throwFatal(char* message, ...);
-void addError(char* message, ...);
-void throwErrors();
-void addErrorAt(Module* module, int startIndex, int endIndex, char* message, ...);
-bool hasErrors();
+void addError(CompilerContext* context, char* message, ...);
+void reportErrors(CompilerContext* context);
+void addErrorAt(CompilerContext* context, size_t startIndex, size_t endIndex, char* message, ...);
+bool hasErrors(CompilerContext* context);
+char* renderError(CompilerContext* context, Error* error);
+void freeError(Error* error);
 
 #endif
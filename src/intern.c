@@ -0,0 +1,158 @@
+#include "intern.h"
+#include "util.h"
+#include <stdint.h>
+#include <string.h>
+
+#define INTERN_INITIAL_CAPACITY 256
+#define INTERN_POOL_BLOCK_SIZE 65536
+#define INTERN_EMPTY -1
+
+typedef struct {
+    char* name;
+    size_t length;
+    uint64_t hash;
+} InternEntry;
+
+typedef struct InternBlock {
+    struct InternBlock* previous;
+    size_t used;
+    size_t capacity;
+    char data[];
+} InternBlock;
+
+struct InternTable {
+    InternEntry* entries;
+    int size;
+    int capacity;
+    int* slots;
+    size_t slotCount;
+    InternBlock* pool;
+};
+
+static uint64_t hashIdentifier(char* start, size_t length)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) start[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+static int* newSlots(size_t count)
+{
+    int* slots = safeMalloc(sizeof(int) * count);
+
+    for (size_t i = 0; i < count; i++) {
+        slots[i] = INTERN_EMPTY;
+    }
+
+    return slots;
+}
+
+InternTable* newInternTable()
+{
+    InternTable* table = safeMalloc(sizeof(InternTable));
+    table->entries = safeMalloc(sizeof(InternEntry) * INTERN_INITIAL_CAPACITY);
+    table->size = 0;
+    table->capacity = INTERN_INITIAL_CAPACITY;
+    table->slotCount = INTERN_INITIAL_CAPACITY * 2;
+    table->slots = newSlots(table->slotCount);
+    table->pool = NULL;
+
+    return table;
+}
+
+static char* copyToPool(InternTable* table, char* start, size_t length)
+{
+    InternBlock* block = table->pool;
+
+    if (block == NULL || block->used + length + 1 > block->capacity) {
+        size_t capacity = length + 1 > INTERN_POOL_BLOCK_SIZE ? length + 1 : INTERN_POOL_BLOCK_SIZE;
+        block = safeMalloc(sizeof(InternBlock) + capacity);
+        block->previous = table->pool;
+        block->used = 0;
+        block->capacity = capacity;
+        table->pool = block;
+    }
+
+    char* name = block->data + block->used;
+    memcpy(name, start, length);
+    name[length] = '\0';
+    block->used += length + 1;
+
+    return name;
+}
+
+static void growSlots(InternTable* table)
+{
+    free(table->slots);
+    table->slotCount *= 2;
+    table->slots = newSlots(table->slotCount);
+    size_t mask = table->slotCount - 1;
+
+    for (int i = 0; i < table->size; i++) {
+        size_t slot = table->entries[i].hash & mask;
+
+        while (table->slots[slot] != INTERN_EMPTY) {
+            slot = (slot + 1) & mask;
+        }
+
+        table->slots[slot] = i;
+    }
+}
+
+int internIdentifier(InternTable* table, char* start, size_t length)
+{
+    uint64_t hash = hashIdentifier(start, length);
+    size_t mask = table->slotCount - 1;
+    size_t slot = hash & mask;
+
+    while (table->slots[slot] != INTERN_EMPTY) {
+        InternEntry* entry = &table->entries[table->slots[slot]];
+
+        if (entry->hash == hash && entry->length == length && !memcmp(entry->name, start, length)) {
+            return table->slots[slot];
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    if (table->size == table->capacity) {
+        table->capacity *= 2;
+        table->entries = safeRealloc(table->entries, sizeof(InternEntry) * table->capacity);
+    }
+
+    int identifier = table->size++;
+    InternEntry* entry = &table->entries[identifier];
+    entry->name = copyToPool(table, start, length);
+    entry->length = length;
+    entry->hash = hash;
+    table->slots[slot] = identifier;
+
+    if ((size_t) table->size * 2 > table->slotCount) {
+        growSlots(table);
+    }
+
+    return identifier;
+}
+
+char* getIdentifierName(InternTable* table, int identifier)
+{
+    return table->entries[identifier].name;
+}
+
+void freeInternTable(InternTable* table)
+{
+    while (table->pool != NULL) {
+        InternBlock* previous = table->pool->previous;
+        free(table->pool);
+        table->pool = previous;
+    }
+
+    free(table->entries);
+    free(table->slots);
+    free(table);
+}
@@ -0,0 +1,13 @@
+#ifndef OPAL_INTERN_H
+#define OPAL_INTERN_H
+
+#include <stddef.h>
+
+typedef struct InternTable InternTable;
+
+InternTable* newInternTable();
+int internIdentifier(InternTable* table, char* start, size_t length);
+char* getIdentifierName(InternTable* table, int identifier);
+void freeInternTable(InternTable* table);
+
+#endif
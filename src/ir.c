@@ -1,12 +1,19 @@
 #include "ir.h"
 #include <stdlib.h>
+#include <stdarg.h>
 #include "stringbuilder.h"
 #include "util.h"
 #include "error.h"
 #include "symbol.h"
+#include "type.h"
+#include <limits.h>
 
-IR* ir;
-Procedure* procedure;
+typedef struct {
+    CompilerContext* context;
+    IR* ir;
+    Procedure* procedure;
+    Span span;
+} IRGenerator;
 
 static IR* makeIR()
 {
@@ -17,194 +24,257 @@ static IR* makeIR()
     return ir;
 }
 
-static Procedure* makeProcedure(char* name)
+static Procedure* makeProcedure(IRGenerator* generator, char* name)
 {
     Procedure* procedure = safeMalloc(sizeof(Procedure));
     procedure->name = name;
     procedure->instructions = newVector();
     procedure->nextRegisterNumber = 0;
     procedure->nextSubProcedureNumber = 0;
-    pushVector(ir->procedures, procedure);
+    pushVector(generator->ir->procedures, procedure);
 
     return procedure;
 }
 
-static Procedure* makeSubProcedure(Procedure* procedure)
-{
-    return makeProcedure(format("%s:%d", procedure->name, procedure->nextSubProcedureNumber++));
-}
-
-static Instruction* makeInstruction(InstructionType type)
+Instruction* newInstruction(InstructionType type)
 {
     Instruction* instruction = safeMalloc(sizeof(Instruction));
     instruction->type = type;
     instruction->operands = newVector();
-    pushVector(procedure->instructions, instruction);
+    instruction->span.startIndex = 0;
+    instruction->span.endIndex = 0;
+    instruction->checks = 0;
 
     return instruction;
 }
 
-static void makeInstruction0(InstructionType type)
+static Instruction* makeInstruction(IRGenerator* generator, InstructionType type)
 {
-    makeInstruction(type);
+    Instruction* instruction = newInstruction(type);
+    instruction->span = generator->span;
+    pushVector(generator->procedure->instructions, instruction);
+
+    return instruction;
 }
 
-static void makeInstruction1(InstructionType type, Operand* operand)
+static void makeInstruction1(IRGenerator* generator, InstructionType type, Operand* operand)
 {
-    Instruction* instruction = makeInstruction(type);
+    Instruction* instruction = makeInstruction(generator, type);
     pushVector(instruction->operands, operand);
 }
 
-static void makeInstruction2(InstructionType type, Operand* operand1, Operand* operand2)
+static void makeInstruction2(IRGenerator* generator, InstructionType type, Operand* operand1, Operand* operand2)
 {
-    Instruction* instruction = makeInstruction(type);
+    Instruction* instruction = makeInstruction(generator, type);
     pushVector(instruction->operands, operand1);
     pushVector(instruction->operands, operand2);
 }
 
-static void makeInstruction3(InstructionType type, Operand* operand1, Operand* operand2, Operand* operand3)
+static Instruction* makeInstruction3(IRGenerator* generator, InstructionType type, Operand* operand1, Operand* operand2, Operand* operand3)
 {
-    Instruction* instruction = makeInstruction(type);
+    Instruction* instruction = makeInstruction(generator, type);
     pushVector(instruction->operands, operand1);
     pushVector(instruction->operands, operand2);
     pushVector(instruction->operands, operand3);
+
+    return instruction;
 }
 
-static Operand* makeOperand(OperandType type)
+static Operand* makeOperand(OperandType type, int width)
 {
     Operand* operand = safeMalloc(sizeof(Operand));
     operand->type = type;
+    operand->width = width;
     
     return operand;
 }
 
-static Operand* makeOperandFromInteger(int integer)
+Operand* newIntegerOperand(int integer, int width)
 {
-    Operand* operand = makeOperand(OPERAND_INTEGER);
+    Operand* operand = makeOperand(OPERAND_INTEGER, width);
     operand->value.integer = integer;
 
     return operand;
 }
 
-static Operand* makeOperandFromRegister(Register* reg)
+static Operand* makeOperandFromRegister(Register* reg, int width)
 {
-    Operand* operand = makeOperand(OPERAND_REGISTER);
+    Operand* operand = makeOperand(OPERAND_REGISTER, width);
     operand->value.reg = reg;
 
     return operand;
 }
 
-static Operand* makeOperandFromMemory(int offset)
+static Operand* makeOperandFromMemory(int offset, int width)
 {
-    Operand* operand = makeOperand(OPERAND_MEMORY);
+    Operand* operand = makeOperand(OPERAND_MEMORY, width);
     operand->value.integer = offset;
 
     return operand;
 }
 
-static Operand* makeRegister()
+Operand* newRegisterOperand(Procedure* procedure, int width)
 {
     Register* reg = safeMalloc(sizeof(Register));
     reg->virtualNumber = procedure->nextRegisterNumber++;
     reg->realNumber = -1;
 
-    return makeOperandFromRegister(reg);
+    return makeOperandFromRegister(reg, width);
 }
 
-static Operand* generateNode(Node* node);
+// Instructions own their operands, so an operand used twice is copied.
+Operand* copyOperand(Operand* operand)
+{
+    Operand* copy = makeOperand(operand->type, operand->width);
+    copy->value = operand->value;
+
+    return copy;
+}
+
+// Nodes whose type could not be inferred are given the width of an integer.
+static int getNodeWidth(IRGenerator* generator, Ast* ast, NodeIndex node)
+{
+    TypeTable* types = generator->context->types;
+    int width = getTypeSize(types, ast->valueTypes[node]);
+
+    return width > 0 ? width : getTypeSize(types, TYPE_INTEGER);
+}
+
+static bool isIntegerOtherThan(Operand* operand, int value)
+{
+    return operand->type == OPERAND_INTEGER && operand->value.integer != value;
+}
+
+// Dividing by a literal other than zero can't fail, nor can raising to a
+// power that is positive or of a base other than zero. Only INT_MIN / -1
+// overflows, which a literal other than those on either side rules out. The
+// other checks are left for the range analysis to remove.
+static int getChecks(InstructionType type, Operand* value1, Operand* value2)
+{
+    int checks = 0;
+
+    switch (type) {
+        case IR_DIVIDE:
+        case IR_MODULO:
+            if (!isIntegerOtherThan(value2, 0)) {
+                checks |= CHECK_ZERO;
+            }
+
+            if (!isIntegerOtherThan(value2, -1) && !isIntegerOtherThan(value1, INT_MIN)) {
+                checks |= CHECK_OVERFLOW;
+            }
+
+            return checks;
+        case IR_POWER:
+            return !isIntegerOtherThan(value1, 0) && !(value2->type == OPERAND_INTEGER && value2->value.integer >= 0) ? CHECK_ZERO : 0;
+        default:
+            return 0;
+    }
+}
 
-static Operand* binaryOperation(Node* node, InstructionType type)
+static Operand* binaryOperation(IRGenerator* generator, Operand** operands, Ast* ast, NodeIndex node, InstructionType type)
 {
-    Operand* value1 = generateNode(node->children.left);
-    Operand* value2 = generateNode(node->children.right);
-    Operand* result = makeRegister(procedure);
-    makeInstruction3(type, value1, value2, result);
+    Operand* value1 = operands[ast->left[node]];
+    Operand* value2 = operands[ast->right[node]];
+    Operand* result = newRegisterOperand(generator->procedure, getNodeWidth(generator, ast, node));
+    Instruction* instruction = makeInstruction3(generator, type, copyOperand(value1), copyOperand(value2), copyOperand(result));
+    instruction->checks = getChecks(type, value1, value2);
 
     return result;
 }
 
-static Operand* generateNode(Node* node)
+static Operand* generateNode(IRGenerator* generator, Operand** operands, Ast* ast, NodeIndex node)
 {
-    switch (node->type) {
+    switch (ast->types[node]) {
         case NODE_ADD:
-            return binaryOperation(node, IR_ADD);
+            return binaryOperation(generator, operands, ast, node, IR_ADD);
         case NODE_SUBSTRACT:
-            return binaryOperation(node, IR_SUBSTRACT);
+            return binaryOperation(generator, operands, ast, node, IR_SUBSTRACT);
         case NODE_MULTIPLY:
-            return binaryOperation(node, IR_MULTIPLY);
+            return binaryOperation(generator, operands, ast, node, IR_MULTIPLY);
         case NODE_DIVIDE:
-            return binaryOperation(node, IR_DIVIDE);
+            return binaryOperation(generator, operands, ast, node, IR_DIVIDE);
         case NODE_MODULO:
-            return binaryOperation(node, IR_MODULO);
+            return binaryOperation(generator, operands, ast, node, IR_MODULO);
         case NODE_NEGATE: {
-            Operand* value = generateNode(node->children.node);
-            Operand* result = makeRegister(procedure);
-            makeInstruction2(IR_NEGATE, value, result);
-
-            return result;
-        }
-        case NODE_INTEGER: {
-            Operand* value = makeOperandFromInteger(node->children.integer);
-            Operand* result = makeRegister(procedure);
-            makeInstruction2(IR_MOVE, value, result);
+            Operand* value = operands[ast->left[node]];
+            Operand* result = newRegisterOperand(generator->procedure, getNodeWidth(generator, ast, node));
+            makeInstruction2(generator, IR_NEGATE, copyOperand(value), copyOperand(result));
 
             return result;
         }
+        case NODE_INTEGER:
+        case NODE_BOOLEAN:
+            return newIntegerOperand(ast->values[node], getNodeWidth(generator, ast, node));
         case NODE_POWER:
-            throwFatal("Raised a value to a power is not supported yet.");
-        case NODE_BOOLEAN: {
-            Operand* value = makeOperandFromInteger(node->children.boolean);
-            Operand* result = makeRegister(procedure);
-            makeInstruction2(IR_MOVE, value, result);
-
-            return result;
-        }
+            return binaryOperation(generator, operands, ast, node, IR_POWER);
         case NODE_STATEMENTS: {
-            Operand* lastOperand;
-
-            for (VECTOR_EACH(node->children.nodes)) {
-                Node* child = VECTOR_GET(node->children.nodes, i);
-                lastOperand = generateNode(child);
-            }
+            NodeIndex last = ast->lists[ast->left[node] + ast->right[node] - 1];
 
-            return lastOperand;
+            return copyOperand(operands[last]);
         }
         case NODE_ASSIGNMENT: {
-            Variable* variable = node->children.variableAssignment;
-            variable->offset = ir->offset;
-            ir->offset += 4;
-            Node* value = node->children.variableValue;
-            Operand* destination = makeOperandFromMemory(variable->offset);
-
-            if (value != NULL) {
-                Operand* source = generateNode(value);
-                makeInstruction2(IR_MOVE, source, destination);
+            Operand* destination = makeOperandFromMemory(generator->ir->offset, getNodeWidth(generator, ast, node));
+            generator->ir->offset += 4;
+            NodeIndex value = ast->left[node];
+
+            if (value != NODE_NONE) {
+                makeInstruction2(generator, IR_MOVE, copyOperand(operands[value]), copyOperand(destination));
             }
 
             return destination;
         }
         case NODE_LOAD: {
-            Variable* variable = node->children.variable;
-            Operand* source = makeOperandFromMemory(variable->offset);
-            Operand* destination = makeRegister();
-            makeInstruction2(IR_MOVE, source, destination);
+            Operand* declaration = operands[ast->left[node]];
+            int width = getNodeWidth(generator, ast, node);
+            Operand* source = makeOperandFromMemory(declaration->value.integer, width);
+            Operand* destination = newRegisterOperand(generator->procedure, width);
+            makeInstruction2(generator, IR_MOVE, source, copyOperand(destination));
 
             return destination;
         }
     }
+
+    return NULL;
 }
 
-IR* generateIR(Node* node)
+// Nodes are stored in post-order, so walking them in index order emits the
+// same instruction sequence as a recursive descent. Each node's operand is
+// kept until its parent consumes it, and instructions are given copies.
+IR* generateIR(CompilerContext* context, Ast* ast)
 {
-    ir = makeIR();
-    procedure = makeProcedure("main");
-    Operand* reg = generateNode(node);
-    makeInstruction1(IR_RETURN, reg);
+    IRGenerator generator;
+    generator.context = context;
+    generator.ir = makeIR();
+    generator.procedure = makeProcedure(&generator, "main");
+    generator.span.startIndex = 0;
+    generator.span.endIndex = 0;
 
-    return ir;
+    if (ast->root == NODE_NONE) {
+        makeInstruction1(&generator, IR_RETURN, newIntegerOperand(0, getTypeSize(context->types, TYPE_INTEGER)));
+
+        return generator.ir;
+    }
+
+    Operand** operands = safeMalloc(sizeof(Operand*) * ast->size);
+
+    for (NodeIndex node = 0; node < ast->size; node++) {
+        generator.span = ast->spans[node];
+        operands[node] = generateNode(&generator, operands, ast, node);
+    }
+
+    makeInstruction1(&generator, IR_RETURN, copyOperand(operands[ast->root]));
+
+    for (NodeIndex node = 0; node < ast->size; node++) {
+        free(operands[node]);
+    }
+
+    free(operands);
+
+    return generator.ir;
 }
 
-static void freeInstruction(Instruction* instruction)
+void freeInstruction(Instruction* instruction)
 {
     for (VECTOR_EACH(instruction->operands)) {
         free(VECTOR_GET(instruction->operands, i));
@@ -234,8 +304,6 @@ void freeIR(IR* ir)
     free(ir);
 }
 
-StringBuilder* builder;
-
 static char* dumpInstructionType(InstructionType type)
 {
     switch (type) {
@@ -255,58 +323,79 @@ static char* dumpInstructionType(InstructionType type)
             return "MOV";
         case IR_NEGATE:
             return "NEG";
+        case IR_POWER:
+            return "POW";
+        case IR_SHIFT_LEFT:
+            return "SHL";
+        case IR_SHIFT_RIGHT:
+            return "SAR";
+        case IR_SHIFT_RIGHT_LOGICAL:
+            return "SHR";
+        case IR_AND:
+            return "AND";
     }
 }
 
-static void emit(char* code)
+static void emit(StringBuilder* builder, char* code)
 {
     appendStringBuilder(builder, code);
 }
 
-static void dumpInstruction(Instruction* instruction)
+static void emitFormat(StringBuilder* builder, char* message, ...)
+{
+    va_list args;
+    va_start(args, message);
+    char* code = formatArguments(message, args);
+    va_end(args);
+    emit(builder, code);
+    free(code);
+}
+
+static void dumpInstruction(StringBuilder* builder, Instruction* instruction)
 {
-    emit(format("    %s ", dumpInstructionType(instruction->type)));
+    emitFormat(builder, "    %s ", dumpInstructionType(instruction->type));
     
     for (VECTOR_EACH(instruction->operands)) {
         Operand* operand = VECTOR_GET(instruction->operands, i);
 
         switch (operand->type) {
             case OPERAND_INTEGER:
-                emit(format("%d", operand->value.integer));
+                emitFormat(builder, "%d", operand->value.integer);
                 break;
             case OPERAND_REGISTER:
-                emit(format("%%%d", operand->value.reg->virtualNumber));
+                emitFormat(builder, "%%%d", operand->value.reg->virtualNumber);
                 break;
             case OPERAND_MEMORY:
-                emit(format("$%d", operand->value.integer));
+                emitFormat(builder, "$%d", operand->value.integer);
                 break;
         }
 
         if (i != VECTOR_SIZE(instruction->operands) - 1) {
-            emit(", ");
+            emit(builder, ", ");
         }
     }
 
-    emit("\n");
+    emit(builder, instruction->checks & CHECK_ZERO ? " (zero checked)" : "");
+    emit(builder, instruction->checks & CHECK_OVERFLOW ? " (overflow checked)\n" : "\n");
 }
 
-static void dumpProcedure(Procedure* procedure)
+static void dumpProcedure(StringBuilder* builder, Procedure* procedure)
 {
-    emit(format("%s\n", procedure->name));
+    emitFormat(builder, "%s\n", procedure->name);
 
     for (VECTOR_EACH(procedure->instructions)) {
-        dumpInstruction(VECTOR_GET(procedure->instructions, i));
+        dumpInstruction(builder, VECTOR_GET(procedure->instructions, i));
     }
 
-    emit("\n");
+    emit(builder, "\n");
 }
 
 char* dumpIR(IR* ir)
 {
-    builder = newStringBuilder();
+    StringBuilder* builder = newStringBuilder();
 
     for (VECTOR_EACH(ir->procedures)) {
-        dumpProcedure(VECTOR_GET(ir->procedures, i));
+        dumpProcedure(builder, VECTOR_GET(ir->procedures, i));
     }
 
     char* dumpedIR = buildStringBuilder(builder);
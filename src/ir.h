@@ -12,6 +12,11 @@ typedef enum {
     IR_RETURN,
     IR_MOVE,
     IR_NEGATE,
+    IR_POWER,
+    IR_SHIFT_LEFT,
+    IR_SHIFT_RIGHT,
+    IR_SHIFT_RIGHT_LOGICAL,
+    IR_AND,
 } InstructionType;
 
 typedef struct {
@@ -27,15 +32,30 @@ typedef enum {
 
 typedef struct {
     OperandType type;
+    int width;
     union {
         Register* reg;
         int integer;
     } value;
 } Operand;
 
+// Checks are flags, as a division may need both.
+typedef enum {
+    CHECK_ZERO = 1,
+    CHECK_OVERFLOW = 2,
+} CheckKind;
+
+// The span is the source of the node the instruction was generated for, or
+// empty when it has none. A division, modulo or power checked for zero stops
+// the program with an error instead of trapping when it would divide by
+// zero. A division or modulo checked for overflow doesn't run idivl on a -1
+// divisor, so INT_MIN / -1 wraps to INT_MIN and INT_MIN % -1 is 0, as when
+// they are folded.
 typedef struct {
     InstructionType type;
     Vector* operands;
+    Span span;
+    int checks;
 } Instruction;
 
 typedef struct {
@@ -50,7 +70,12 @@ typedef struct {
     int offset;
 } IR;
 
-IR* generateIR(Node* node);
+IR* generateIR(CompilerContext* context, Ast* ast);
+Instruction* newInstruction(InstructionType type);
+Operand* newIntegerOperand(int integer, int width);
+Operand* newRegisterOperand(Procedure* procedure, int width);
+Operand* copyOperand(Operand* operand);
+void freeInstruction(Instruction* instruction);
 void freeIR(IR* ir);
 char* dumpIR(IR* ir);
 
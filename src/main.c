@@ -7,53 +7,190 @@
 #include "debug.h"
 #include "ir.h"
 #include "arch.h"
+#include "optimize.h"
+#include "context.h"
+#include "server.h"
+#include "pass.h"
+#include "remark.h"
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 
-static void throwErrorsIfNeeded()
+// Library code only records errors on the context; the process exits here.
+static void throwErrors(CompilerContext* context)
 {
-    if (hasErrors()) {
+    reportErrors(context);
+    exit(1);
+}
+
+static void throwErrorsIfNeeded(CompilerContext* context)
+{
+    if (hasErrors(context)) {
         fprintf(stderr, "Compilation failed.\n");
-        throwErrors();
+        throwErrors(context);
     }
 }
 
+static void reduceStrengthForTarget(CompilerContext* context, IR* ir)
+{
+    reduceStrength(context, ir, getRegisterCount());
+}
+
+static void numberValuesForTarget(CompilerContext* context, IR* ir)
+{
+    numberValues(context, ir, getRegisterCount());
+}
+
+typedef struct {
+    bool server;
+    bool timeReport;
+    int printedRemarks;
+    char* recordFilename;
+} Options;
+
+// Returns the filename, or NULL when none was given.
+static char* parseOptions(CompilerContext* context, int argc, char** argv, Options* options)
+{
+    char* filename = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        char* argument = argv[i];
+
+        if (!strncmp(argument, "-fmax-depth=", 12)) {
+            char* end;
+            long depth = strtol(argument + 12, &end, 10);
+
+            if (*end != '\0' || end == argument + 12 || depth < 1 || depth > INT_MAX) {
+                addError(context, "Invalid maximum nesting depth \"%s\".", argument + 12);
+            }
+
+            context->maxNestingDepth = depth;
+        } else if (!strncmp(argument, "-O", 2)) {
+            if (argument[2] < '0' || argument[2] > '2' || argument[3] != '\0') {
+                addError(context, "Invalid optimization level \"%s\".", argument + 2);
+            }
+
+            context->optimizationLevel = argument[2] - '0';
+        } else if (!strcmp(argument, "-ftime-report")) {
+            options->timeReport = true;
+        } else if (!strcmp(argument, "-Rpass")) {
+            options->printedRemarks |= REMARK_PASSED;
+        } else if (!strcmp(argument, "-Rpass-missed")) {
+            options->printedRemarks |= REMARK_MISSED;
+        } else if (!strncmp(argument, "-fsave-optimization-record=", 27)) {
+            if (argument[27] == '\0') {
+                addError(context, "Missing optimization record filename.");
+            }
+
+            options->recordFilename = argument + 27;
+        } else if (!strcmp(argument, "--server")) {
+            options->server = true;
+        } else if (argument[0] == '-' && argument[1] != '\0') {
+            addError(context, "Unknown option \"%s\".", argument);
+        } else {
+            filename = argument;
+        }
+    }
+
+    if (hasErrors(context)) {
+        throwErrors(context);
+    }
+
+    return filename;
+}
+
 int main(int argc, char** argv)
 {
-    if (argc < 2) {
+    CompilerContext* context = newCompilerContext();
+    Options options = {false, false, 0, NULL};
+    char* filename = parseOptions(context, argc, argv, &options);
+
+    if (options.server) {
+        int depth = context->maxNestingDepth;
+        freeCompilerContext(context);
+
+        return serve(stdin, stdout, depth);
+    }
+
+    if (filename == NULL) {
         printf("[USAGE] opal <filename>\n");
 
         return 0;
     }
 
-    Module* module = newModuleFromFilename(argv[1]);
+    // The record holds every remark, whichever are printed.
+    context->remarkKinds = options.recordFilename != NULL ? REMARK_PASSED | REMARK_MISSED : options.printedRemarks;
+    PassManager* passes = newPassManager(context, options.timeReport);
+    addAstPass(passes, "fold", 0, foldAst);
+    addAstPass(passes, "dead-statements", 1, removeDeadStatements);
+    addIRPass(passes, "division-checks", 1, removeDivisionChecks);
+    addIRPass(passes, "strength-reduction", 1, reduceStrengthForTarget);
+    addIRPass(passes, "value-numbering", 2, numberValuesForTarget);
+    addIRPass(passes, "dead-code", 1, removeDeadCode);
+
+    startPass(passes);
+    Module* module = newModuleFromFilename(context, filename);
+    finishPass(passes, "read");
+
+    if (hasErrors(context)) {
+        throwErrors(context);
+    }
 
     // SCANNING
     printf("Scanning module \"%s\"...\n", module->name);
-    Vector* tokens = scan(module);
-    throwErrorsIfNeeded();
-    // debugTokens(tokens);
+    startPass(passes);
+    TokenBuffer* tokens = scan(context);
+    finishPass(passes, "scan");
+    throwErrorsIfNeeded(context);
+    // debugTokens(context, tokens);
 
     // PARSING
     printf("Parsing module \"%s\"...\n", module->name);
-    Node* node = parse(module, tokens);
-    freeVector(tokens);
-    throwErrorsIfNeeded();
-    optimizeNode(module, node);
-    throwErrorsIfNeeded();
-    // printf("%d", interpretNode(node));
+    startPass(passes);
+    Ast* ast = parse(context, tokens);
+    finishPass(passes, "parse");
+    freeTokenBuffer(tokens);
+    throwErrorsIfNeeded(context);
+    runAstPasses(passes, ast);
+    throwErrorsIfNeeded(context);
+    // printf("%d", interpretNode(ast, ast->root));
 
     // GENERATING IR
-    IR* ir = generateIR(node);
-    freeNode(node);
+    startPass(passes);
+    IR* ir = generateIR(context, ast);
+    finishPass(passes, "generate-ir");
+    resetArena(context->arena);
+    runIRPasses(passes, ir);
     // printf("%s", dumpIR(ir));
     // interpretIR(ir);
 
     // GENERATING ASSEMBLY
-    char* assemblyCode = generateAssembly(ir);
+    startPass(passes);
+    char* assemblyCode = generateAssembly(context, ir);
+    finishPass(passes, "generate-assembly");
     freeIR(ir);
     // printf("%s", assemblyCode);
 
-    freeModule(module);
+    if (options.timeReport) {
+        writeTimeReport(passes, stderr);
+    }
+
+    writeRemarks(context, stderr, options.printedRemarks);
+
+    if (options.recordFilename != NULL) {
+        FILE* record = fopen(options.recordFilename, "w");
+
+        if (record == NULL) {
+            addError(context, "Can't write the optimization record \"%s\".", options.recordFilename);
+            throwErrors(context);
+        }
+
+        writeRemarksJson(context, record);
+        fclose(record);
+    }
+
+    freePassManager(passes);
+    freeCompilerContext(context);
 
     FILE* generated = fopen("generated.s", "w");
     fputs(assemblyCode, generated);
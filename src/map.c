@@ -2,35 +2,172 @@
 #include "util.h"
 #include <string.h>
 
+#define MAP_INITIAL_CAPACITY 16
+#define MAP_GROUP_WIDTH 8
+#define MAP_EMPTY 0x80
+#define MAP_LOW_BITS 0x0101010101010101ULL
+#define MAP_HIGH_BITS 0x8080808080808080ULL
+
+// Open addressing with a SwissTable-style control byte per slot: MAP_EMPTY,
+// or the top 7 bits of the key's hash when the slot is full. Slots are
+// probed a group of 8 control bytes at a time, and keys are only compared
+// for the bytes whose hash bits match.
+
+static uint64_t hashKey(int key)
+{
+    return (uint64_t) (uint32_t) key * 0x9E3779B97F4A7C15ULL;
+}
+
+static uint8_t getControl(uint64_t hash)
+{
+    return hash >> 57;
+}
+
+static uint64_t loadGroup(Map* map, int group)
+{
+    uint64_t controls;
+    memcpy(&controls, map->controls + group * MAP_GROUP_WIDTH, sizeof(controls));
+
+    return controls;
+}
+
+// May report a false positive right after a real match, which the key
+// comparison filters out.
+static uint64_t matchControl(uint64_t controls, uint8_t control)
+{
+    uint64_t matches = controls ^ (MAP_LOW_BITS * control);
+
+    return (matches - MAP_LOW_BITS) & ~matches & MAP_HIGH_BITS;
+}
+
+static uint64_t matchEmpty(uint64_t controls)
+{
+    return controls & MAP_HIGH_BITS;
+}
+
+static int getMatchOffset(uint64_t matches)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_ctzll(matches) / 8;
+#else
+    return __builtin_clzll(matches) / 8;
+#endif
+}
+
+static uint64_t clearMatch(uint64_t matches, int offset)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return matches & (matches - 1);
+#else
+    return matches & ~(0x80ULL << ((MAP_GROUP_WIDTH - 1 - offset) * 8));
+#endif
+}
+
+static void allocateSlots(Map* map, int capacity)
+{
+    map->controls = safeMalloc(capacity);
+    memset(map->controls, MAP_EMPTY, capacity);
+    map->keys = safeMalloc(sizeof(int) * capacity);
+    map->values = safeMalloc(sizeof(void*) * capacity);
+    map->capacity = capacity;
+    map->size = 0;
+}
+
 Map* newMap()
 {
     Map* map = safeMalloc(sizeof(Map));
-    map->keys = newVector();
-    map->values = newVector();
+    allocateSlots(map, MAP_INITIAL_CAPACITY);
 
     return map;
 }
 
 void freeMap(Map* map)
 {
-    freeVector(map->keys);
-    freeVector(map->values);
+    free(map->controls);
+    free(map->keys);
+    free(map->values);
     free(map);
 }
 
-void setMap(Map* map, char* key, void* value)
+// Groups are visited in triangular order, which reaches every group of a
+// power-of-two table.
+static int findSlot(Map* map, int key, uint64_t hash, bool* found)
 {
-    pushVector(map->keys, key);
-    pushVector(map->values, value);
+    int groupMask = map->capacity / MAP_GROUP_WIDTH - 1;
+    int group = (hash >> 7) & groupMask;
+    uint8_t control = getControl(hash);
+
+    for (int step = 1; ; step++) {
+        uint64_t controls = loadGroup(map, group);
+        uint64_t matches = matchControl(controls, control);
+
+        while (matches) {
+            int offset = getMatchOffset(matches);
+            int slot = group * MAP_GROUP_WIDTH + offset;
+
+            if (map->controls[slot] == control && map->keys[slot] == key) {
+                *found = true;
+
+                return slot;
+            }
+
+            matches = clearMatch(matches, offset);
+        }
+
+        uint64_t empty = matchEmpty(controls);
+
+        if (empty) {
+            *found = false;
+
+            return group * MAP_GROUP_WIDTH + getMatchOffset(empty);
+        }
+
+        group = (group + step) & groupMask;
+    }
 }
 
-void* getMap(Map* map, char* key)
+static void growMap(Map* map)
 {
-    for (VECTOR_EACH(map->keys)) {
-        if (!strcmp(VECTOR_GET(map->keys, i), key)) {
-            return VECTOR_GET(map->values, i);
+    uint8_t* controls = map->controls;
+    int* keys = map->keys;
+    void** values = map->values;
+    int capacity = map->capacity;
+    allocateSlots(map, capacity * 2);
+
+    for (int i = 0; i < capacity; i++) {
+        if (controls[i] != MAP_EMPTY) {
+            setMap(map, keys[i], values[i]);
         }
     }
 
-    return NULL;
+    free(controls);
+    free(keys);
+    free(values);
+}
+
+void setMap(Map* map, int key, void* value)
+{
+    if ((map->size + 1) * 8 > map->capacity * 7) {
+        growMap(map);
+    }
+
+    uint64_t hash = hashKey(key);
+    bool found;
+    int slot = findSlot(map, key, hash, &found);
+
+    if (!found) {
+        map->controls[slot] = getControl(hash);
+        map->keys[slot] = key;
+        map->size++;
+    }
+
+    map->values[slot] = value;
+}
+
+void* getMap(Map* map, int key)
+{
+    bool found;
+    int slot = findSlot(map, key, hashKey(key), &found);
+
+    return found ? map->values[slot] : NULL;
 }
@@ -3,49 +3,440 @@
 #include "error.h"
 #include "util.h"
 #include <stdlib.h>
+#include <string.h>
+#include "simd.h"
 
-static char* readFile(char* filename)
+#if defined(__unix__) || defined(__APPLE__)
+#define MODULE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define READ_CHUNK_SIZE 65536
+#define LINE_STARTS_INITIAL_CAPACITY 64
+
+static bool readStream(CompilerContext* context, Module* module, FILE* file, char* filename)
+{
+    size_t capacity = READ_CHUNK_SIZE;
+    size_t size = 0;
+    char* buffer = safeMalloc(capacity + 2);
+
+    while (true) {
+        if (size == capacity) {
+            capacity *= 2;
+            buffer = safeRealloc(buffer, capacity + 2);
+        }
+
+        size_t sizeRead = fread(buffer + size, sizeof(char), capacity - size, file);
+        size += sizeRead;
+
+        if (sizeRead == 0) {
+            break;
+        }
+    }
+
+    if (ferror(file)) {
+        addError(context, "Failed to read \"%s\".", filename);
+        free(buffer);
+
+        return false;
+    }
+
+    buffer[size] = '\0';
+    buffer[size + 1] = '\0';
+    module->source = buffer;
+    module->length = size;
+    module->capacity = capacity;
+    module->mapped = false;
+
+    return true;
+}
+
+#ifdef MODULE_MMAP
+// The file is mapped over a slightly larger anonymous reservation so that
+// the two bytes following the source are always readable '\0's, like the
+// heap path: the scanner may step one byte past the terminator.
+static bool mapFile(Module* module, int descriptor, size_t size)
+{
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t mappedSize = ((size + 1) / pageSize + 1) * pageSize;
+    char* region = mmap(NULL, mappedSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (region == MAP_FAILED) {
+        return false;
+    }
+
+    if (mmap(region, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, descriptor, 0) == MAP_FAILED) {
+        munmap(region, mappedSize);
+
+        return false;
+    }
+
+    madvise(region, size, MADV_SEQUENTIAL);
+    module->source = region;
+    module->length = size;
+    module->capacity = size;
+    module->mapped = true;
+    module->mappedSize = mappedSize;
+
+    return true;
+}
+#endif
+
+static bool readFile(CompilerContext* context, Module* module, char* filename)
 {
+    if (!strcmp(filename, "-")) {
+        return readStream(context, module, stdin, filename);
+    }
+
     FILE* file = fopen(filename, "rb");
 
     if (file == NULL) {
-        addError("Failed to open \"%s\".", filename);
-        throwErrors();
+        addError(context, "Failed to open \"%s\".", filename);
+
+        return false;
+    }
+
+#ifdef MODULE_MMAP
+    struct stat status;
+
+    if (
+        !fstat(fileno(file), &status) &&
+        S_ISREG(status.st_mode) &&
+        status.st_size > 0 &&
+        mapFile(module, fileno(file), status.st_size)
+    ) {
+        fclose(file);
+
+        return true;
+    }
+#endif
+
+    bool read = readStream(context, module, file, filename);
+
+    if (fclose(file) && read) {
+        addError(context, "Failed to close \"%s\".", filename);
+        free(module->source);
+
+        return false;
+    }
+
+    return read;
+}
+
+static bool isContinuationByte(unsigned char c)
+{
+    return (c & 0xC0) == 0x80;
+}
+
+// Returns the length of the UTF-8 sequence starting at position, or 0 when
+// it is malformed, overlong, a surrogate or above U+10FFFF. In that case
+// invalid points to the first byte that breaks the sequence.
+static size_t decodeUtf8(unsigned char* position, unsigned char** invalid)
+{
+    unsigned char lead = position[0];
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+    size_t length;
+
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        low = lead == 0xE0 ? 0xA0 : low;
+        high = lead == 0xED ? 0x9F : high;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        low = lead == 0xF0 ? 0x90 : low;
+        high = lead == 0xF4 ? 0x8F : high;
+    } else {
+        *invalid = position;
+
+        return 0;
     }
-    
-    fseek(file, 0, SEEK_END);
-    size_t size = ftell(file);
-    rewind(file);
 
-    char* buffer = safeMalloc((size + 1) * sizeof(char));
-    size_t sizeRead = fread(buffer, sizeof(char), size, file);
+    if (position[1] < low || position[1] > high) {
+        *invalid = position + 1;
 
-    if (sizeRead < size) {
-        addError("Failed to read \"%s\".", filename);
-        throwErrors();
+        return 0;
     }
-    
-    if (fclose(file)) {
-        addError("Failed to close \"%s\".", filename);
-        throwErrors();
+
+    for (size_t i = 2; i < length; i++) {
+        if (!isContinuationByte(position[i])) {
+            *invalid = position + i;
+
+            return 0;
+        }
     }
 
-    buffer[sizeRead] = '\0';
+    return length;
+}
+
+// ASCII runs are skipped by the vector kernel; only multibyte sequences are
+// decoded one by one. Stops at the first invalid sequence.
+static bool validateEncoding(CompilerContext* context, Module* module)
+{
+    char* end = module->source + module->length;
+    char* position = findNonAscii(module->source);
+
+    while (position < end) {
+        if (*position == '\0') {
+            position = findNonAscii(position + 1);
+
+            continue;
+        }
+
+        unsigned char* invalid;
+        size_t length = decodeUtf8((unsigned char*) position, &invalid);
+
+        if (length == 0) {
+            addErrorAt(context, position - module->source, (char*) invalid - module->source + 1, "Invalid UTF-8 sequence.");
 
-    return buffer;
+            return false;
+        }
+
+        position = findNonAscii(position + length);
+    }
+
+    return true;
 }
 
-Module* newModuleFromFilename(char* filename)
+// Every invalid sequence starting in the widened range is reported, not only
+// the first one. A sequence is at most four bytes long and decoding always
+// restarts at a byte that isn't a continuation byte, so nothing outside the
+// range can change after an edit inside [*startIndex, *endIndex).
+void revalidateEncoding(CompilerContext* context, Module* module, size_t* startIndex, size_t* endIndex)
+{
+    unsigned char* source = (unsigned char*) module->source;
+    size_t start = *startIndex > 3 ? *startIndex - 3 : 0;
+    size_t end = *endIndex + 3 < module->length ? *endIndex + 3 : module->length;
+
+    while (start > 0 && isContinuationByte(source[start])) {
+        start--;
+    }
+
+    while (end < module->length && isContinuationByte(source[end])) {
+        end++;
+    }
+
+    size_t position = start;
+
+    while (position < end) {
+        if (source[position] < 0x80) {
+            position++;
+
+            continue;
+        }
+
+        unsigned char* invalid;
+        size_t length = decodeUtf8(source + position, &invalid);
+
+        if (length == 0) {
+            addErrorAt(context, position, invalid - source + 1, "Invalid UTF-8 sequence.");
+            position++;
+
+            continue;
+        }
+
+        position += length;
+    }
+
+    *startIndex = start;
+    *endIndex = end;
+}
+
+// Returns NULL when the file can't be read. An invalid encoding is recorded
+// on the context but the module is still returned, since rendering the
+// error needs its source.
+Module* newModuleFromFilename(CompilerContext* context, char* filename)
 {
     Module* module = safeMalloc(sizeof(Module));
     module->filename = filename;
     module->name = filename;
-    module->source = readFile(filename);
+    module->lineStarts = NULL;
+    module->lineCount = 0;
+
+    if (!readFile(context, module, filename)) {
+        free(module);
+
+        return NULL;
+    }
+
+    context->module = module;
+    validateEncoding(context, module);
+
+    return module;
+}
+
+// The source must be followed by two '\0' bytes. The module takes
+// ownership of it.
+Module* newModuleFromSource(char* name, char* source, size_t length)
+{
+    Module* module = safeMalloc(sizeof(Module));
+    module->filename = name;
+    module->name = name;
+    module->source = source;
+    module->length = length;
+    module->capacity = length;
+    module->mapped = false;
+    module->lineStarts = NULL;
+    module->lineCount = 0;
 
     return module;
 }
 
+static void freeSource(Module* module)
+{
+#ifdef MODULE_MMAP
+    if (module->mapped) {
+        munmap(module->source, module->mappedSize);
+
+        return;
+    }
+#endif
+
+    free(module->source);
+}
+
 void freeModule(Module* module)
 {
+    free(module->lineStarts);
+    freeSource(module);
     free(module);
 }
+
+static void indexLines(Module* module)
+{
+    size_t capacity = LINE_STARTS_INITIAL_CAPACITY;
+    size_t* lineStarts = safeMalloc(sizeof(size_t) * capacity);
+    size_t count = 0;
+    char* end = module->source + module->length;
+    char* line = module->source;
+
+    while (true) {
+        if (count == capacity) {
+            capacity *= 2;
+            lineStarts = safeRealloc(lineStarts, sizeof(size_t) * capacity);
+        }
+
+        lineStarts[count++] = line - module->source;
+        char* newLine = findCharacter(line, '\n');
+
+        while (*newLine != '\n' && newLine < end) {
+            newLine = findCharacter(newLine + 1, '\n');
+        }
+
+        if (newLine >= end) {
+            break;
+        }
+
+        line = newLine + 1;
+    }
+
+    module->lineStarts = lineStarts;
+    module->lineCount = count;
+}
+
+size_t getModuleLine(Module* module, size_t index)
+{
+    if (module->lineStarts == NULL) {
+        indexLines(module);
+    }
+
+    size_t low = 0;
+    size_t high = module->lineCount;
+
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+
+        if (module->lineStarts[middle] <= index) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low + 1;
+}
+
+size_t getModuleLineStart(Module* module, size_t line)
+{
+    if (module->lineStarts == NULL) {
+        indexLines(module);
+    }
+
+    return module->lineStarts[line - 1];
+}
+
+size_t getModuleLineEnd(Module* module, size_t line)
+{
+    if (module->lineStarts == NULL) {
+        indexLines(module);
+    }
+
+    return line < module->lineCount ? module->lineStarts[line] - 1 : module->length;
+}
+
+static void editLines(Module* module, size_t startIndex, size_t endIndex, char* text, size_t length)
+{
+    size_t first = getModuleLine(module, startIndex);
+    size_t last = getModuleLine(module, endIndex);
+    size_t added = 0;
+
+    for (char* newLine = memchr(text, '\n', length); newLine != NULL; newLine = memchr(newLine + 1, '\n', text + length - newLine - 1)) {
+        added++;
+    }
+
+    size_t count = module->lineCount - (last - first) + added;
+
+    if (added > last - first) {
+        module->lineStarts = safeRealloc(module->lineStarts, sizeof(size_t) * count);
+    }
+
+    size_t* lineStarts = module->lineStarts;
+    memmove(lineStarts + first + added, lineStarts + last, sizeof(size_t) * (module->lineCount - last));
+
+    for (size_t i = 0, line = first; i < length; i++) {
+        if (text[i] == '\n') {
+            lineStarts[line++] = startIndex + i + 1;
+        }
+    }
+
+    for (size_t line = first + added; line < count; line++) {
+        lineStarts[line] = lineStarts[line] - (endIndex - startIndex) + length;
+    }
+
+    module->lineCount = count;
+}
+
+// Replaces the bytes in [startIndex, endIndex) with text. A mapped source is
+// copied to the heap first.
+void editModule(Module* module, size_t startIndex, size_t endIndex, char* text, size_t length)
+{
+    size_t newLength = module->length - (endIndex - startIndex) + length;
+
+    if (module->mapped || newLength > module->capacity) {
+        size_t capacity = newLength > module->capacity * 2 ? newLength : module->capacity * 2;
+        char* source = safeMalloc(capacity + 2);
+        memcpy(source, module->source, module->length + 2);
+        freeSource(module);
+        module->source = source;
+        module->capacity = capacity;
+        module->mapped = false;
+    }
+
+    if (module->lineStarts != NULL) {
+        editLines(module, startIndex, endIndex, text, length);
+    }
+
+    char* source = module->source;
+
+    if (newLength != module->length) {
+        memmove(source + startIndex + length, source + endIndex, module->length - endIndex + 2);
+    }
+
+    memcpy(source + startIndex, text, length);
+    module->length = newLength;
+}
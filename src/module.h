@@ -1,13 +1,30 @@
 #ifndef OPAL_MODULE_H
 #define OPAL_MODULE_H
 
+#include <stddef.h>
+#include <stdbool.h>
+
 typedef struct {
     char* name;
     char* filename;
     char* source;
+    size_t length;
+    size_t capacity;
+    bool mapped;
+    size_t mappedSize;
+    size_t* lineStarts;
+    size_t lineCount;
 } Module;
 
-Module* newModuleFromFilename(char* filaname);
+struct CompilerContext;
+
+Module* newModuleFromFilename(struct CompilerContext* context, char* filaname);
+Module* newModuleFromSource(char* name, char* source, size_t length);
+void editModule(Module* module, size_t startIndex, size_t endIndex, char* text, size_t length);
+void revalidateEncoding(struct CompilerContext* context, Module* module, size_t* startIndex, size_t* endIndex);
 void freeModule(Module* module);
+size_t getModuleLine(Module* module, size_t index);
+size_t getModuleLineStart(Module* module, size_t line);
+size_t getModuleLineEnd(Module* module, size_t line);
 
 #endif
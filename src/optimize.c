@@ -0,0 +1,1032 @@
+#include "optimize.h"
+#include "util.h"
+#include "remark.h"
+#include "map.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_UNROLLED_EXPONENT 64
+
+// Returns k when the operand is the integer 2^k with k > 0, and 0 otherwise.
+static int getPowerOfTwo(Operand* operand)
+{
+    if (operand->type != OPERAND_INTEGER || operand->value.integer <= 1) {
+        return 0;
+    }
+
+    unsigned int value = operand->value.integer;
+
+    if ((value & (value - 1)) != 0) {
+        return 0;
+    }
+
+    int power = 0;
+
+    while (value > 1) {
+        value >>= 1;
+        power++;
+    }
+
+    return power;
+}
+
+// Finds where each register of the procedure is defined and last used, and
+// counts the registers live between each instruction and the next, which
+// the backend must hold at once since it doesn't spill.
+static void computeLiveRanges(Procedure* procedure, int* definitions, int* lastUses, int* occupancy)
+{
+    int count = VECTOR_SIZE(procedure->instructions);
+
+    for (int number = 0; number <= procedure->nextRegisterNumber; number++) {
+        definitions[number] = -1;
+        lastUses[number] = -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        Instruction* instruction = VECTOR_GET(procedure->instructions, i);
+
+        for (int j = 0; j < VECTOR_SIZE(instruction->operands); j++) {
+            Operand* operand = VECTOR_GET(instruction->operands, j);
+
+            if (operand->type != OPERAND_REGISTER) {
+                continue;
+            }
+
+            int number = operand->value.reg->virtualNumber;
+
+            if (definitions[number] == -1) {
+                definitions[number] = i;
+            }
+
+            lastUses[number] = i;
+        }
+
+        occupancy[i] = 0;
+    }
+
+    for (int number = 0; number < procedure->nextRegisterNumber; number++) {
+        for (int point = definitions[number]; point >= 0 && point < lastUses[number]; point++) {
+            occupancy[point]++;
+        }
+    }
+}
+
+static void pushInstruction(Vector* instructions, InstructionType type, Operand* operand1, Operand* operand2, Operand* result)
+{
+    Instruction* instruction = newInstruction(type);
+    pushVector(instruction->operands, operand1);
+    pushVector(instruction->operands, operand2);
+    pushVector(instruction->operands, result);
+    pushVector(instructions, instruction);
+}
+
+// Adds 2^power - 1 to a negative dividend so that shifting it right rounds
+// toward zero like idivl does. The bias is the sign spread over the whole
+// register, shifted logically. The dividend operand is consumed.
+static Operand* biasDividend(Procedure* procedure, Vector* instructions, Operand* dividend, int power)
+{
+    int width = dividend->width;
+    int bits = width * 8;
+    Operand* sign = copyOperand(dividend);
+
+    if (power > 1) {
+        sign = newRegisterOperand(procedure, width);
+        pushInstruction(instructions, IR_SHIFT_RIGHT, copyOperand(dividend), newIntegerOperand(bits - 1, width), sign);
+        sign = copyOperand(sign);
+    }
+
+    Operand* bias = newRegisterOperand(procedure, width);
+    pushInstruction(instructions, IR_SHIFT_RIGHT_LOGICAL, sign, newIntegerOperand(bits - power, width), bias);
+    Operand* biased = newRegisterOperand(procedure, width);
+    pushInstruction(instructions, IR_ADD, dividend, copyOperand(bias), biased);
+
+    return copyOperand(biased);
+}
+
+static void reportDivision(CompilerContext* context, Instruction* instruction, Operand* divisor)
+{
+    Span span = instruction->span;
+    char* operation = instruction->type == IR_DIVIDE ? "Division" : "Modulo";
+
+    if (divisor->type != OPERAND_INTEGER) {
+        addRemarkAt(context, REMARK_MISSED, "strength-reduction", span.startIndex, span.endIndex,
+            "%s kept as idivl: the divisor isn't constant.", operation);
+    } else {
+        addRemarkAt(context, REMARK_MISSED, "strength-reduction", span.startIndex, span.endIndex,
+            "%s by %d kept as idivl: %d isn't a positive power of two.", operation, divisor->value.integer, divisor->value.integer);
+    }
+}
+
+// Rewrites the instruction in place when its second operand is a power of
+// two, after pushing the instructions it now depends on. Its operands are
+// reused, so nothing is freed here. The shifts replacing a division hold the
+// sign of the dividend while it's still live, so they need a free register.
+static void reduceInstruction(CompilerContext* context, Procedure* procedure, Vector* instructions, Instruction* instruction, bool registerFree)
+{
+    Operand** operands = (Operand**) instruction->operands->items;
+
+    if (instruction->type == IR_MULTIPLY && getPowerOfTwo(operands[0]) && !getPowerOfTwo(operands[1])) {
+        Operand* swapped = operands[0];
+        operands[0] = operands[1];
+        operands[1] = swapped;
+    }
+
+    int power = getPowerOfTwo(operands[1]);
+    Span span = instruction->span;
+
+    if (power == 0) {
+        if (instruction->type != IR_MULTIPLY) {
+            reportDivision(context, instruction, operands[1]);
+        }
+
+        return;
+    }
+
+    if (instruction->type != IR_MULTIPLY && !registerFree) {
+        addRemarkAt(context, REMARK_MISSED, "strength-reduction", span.startIndex, span.endIndex,
+            "%s by %d kept as idivl: shifting needs a register and none is free.",
+            instruction->type == IR_DIVIDE ? "Division" : "Modulo", operands[1]->value.integer);
+
+        return;
+    }
+
+    switch (instruction->type) {
+        case IR_MULTIPLY:
+            addRemarkAt(context, REMARK_PASSED, "strength-reduction", span.startIndex, span.endIndex,
+                "Multiplication by %d reduced to a shift.", operands[1]->value.integer);
+            instruction->type = IR_SHIFT_LEFT;
+            operands[1]->value.integer = power;
+            break;
+        case IR_DIVIDE:
+            addRemarkAt(context, REMARK_PASSED, "strength-reduction", span.startIndex, span.endIndex,
+                "Division by %d reduced to shifts.", operands[1]->value.integer);
+            operands[0] = biasDividend(procedure, instructions, operands[0], power);
+            operands[1]->value.integer = power;
+            instruction->type = IR_SHIFT_RIGHT;
+            break;
+        case IR_MODULO: {
+            // x % 2^k is x minus the quotient shifted back, which is the biased
+            // dividend with its low k bits cleared.
+            addRemarkAt(context, REMARK_PASSED, "strength-reduction", span.startIndex, span.endIndex,
+                "Modulo by %d reduced to shifts and a mask.", operands[1]->value.integer);
+            Operand* biased = biasDividend(procedure, instructions, copyOperand(operands[0]), power);
+            Operand* rounded = newRegisterOperand(procedure, operands[0]->width);
+            operands[1]->value.integer = -operands[1]->value.integer;
+            pushInstruction(instructions, IR_AND, biased, operands[1], rounded);
+            operands[1] = copyOperand(rounded);
+            instruction->type = IR_SUBSTRACT;
+            break;
+        }
+    }
+}
+
+// Unrolls a small constant exponent into the multiplications exponentiation
+// by squaring would do, from the most significant bit down: x^5 squares x
+// twice and multiplies by x. The instruction becomes the last of them.
+static void unrollPower(CompilerContext* context, Procedure* procedure, Vector* instructions, Instruction* instruction, bool registerFree)
+{
+    Operand** operands = (Operand**) instruction->operands->items;
+    Operand* base = operands[0];
+    Operand* exponent = operands[1];
+    Span span = instruction->span;
+
+    if (exponent->type != OPERAND_INTEGER) {
+        addRemarkAt(context, REMARK_MISSED, "strength-reduction", span.startIndex, span.endIndex,
+            "Power kept as a loop: the exponent isn't constant.");
+
+        return;
+    }
+
+    if (exponent->value.integer < 2 || exponent->value.integer > MAX_UNROLLED_EXPONENT) {
+        addRemarkAt(context, REMARK_MISSED, "strength-reduction", span.startIndex, span.endIndex,
+            "Power %d kept as a loop: only exponents from 2 to %d are unrolled.", exponent->value.integer, MAX_UNROLLED_EXPONENT);
+
+        return;
+    }
+
+    int value = exponent->value.integer;
+    bool byBase[MAX_UNROLLED_EXPONENT];
+    int count = 0;
+    int bit = 0;
+
+    while (value >> (bit + 1)) {
+        bit++;
+    }
+
+    while (bit-- > 0) {
+        byBase[count++] = false;
+
+        if (value >> bit & 1) {
+            byBase[count++] = true;
+        }
+    }
+
+    // Past x^2, the partial powers are held while the base is still live.
+    if (count > 1 && !registerFree) {
+        addRemarkAt(context, REMARK_MISSED, "strength-reduction", span.startIndex, span.endIndex,
+            "Power %d kept as a loop: unrolling it needs a register and none is free.", value);
+
+        return;
+    }
+
+    Operand* power = copyOperand(base);
+
+    for (int i = 0; i < count - 1; i++) {
+        Operand* factor = copyOperand(byBase[i] ? base : power);
+        Operand* result = newRegisterOperand(procedure, base->width);
+        pushInstruction(instructions, IR_MULTIPLY, power, factor, result);
+        power = copyOperand(result);
+    }
+
+    addRemarkAt(context, REMARK_PASSED, "strength-reduction", span.startIndex, span.endIndex,
+        "Power %d unrolled into %d multiplications.", value, count);
+    operands[0] = power;
+    operands[1] = copyOperand(byBase[count - 1] ? base : power);
+    instruction->type = IR_MULTIPLY;
+    free(base);
+    free(exponent);
+}
+
+// Replaces multiplications, divisions and modulos by a power of two with
+// shifts, which take a cycle where idivl takes tens of them, and constant
+// powers with multiplications. The instructions added take the span of the
+// one they were derived from. A rewrite needing a register more than the
+// instruction it replaces is only done when fewer than registerCount are live.
+void reduceStrength(CompilerContext* context, IR* ir, int registerCount)
+{
+    for (VECTOR_EACH(ir->procedures)) {
+        Procedure* procedure = VECTOR_GET(ir->procedures, i);
+        Vector* instructions = newVector();
+        int registers = procedure->nextRegisterNumber + 1;
+        int* definitions = safeMalloc(sizeof(int) * registers);
+        int* lastUses = safeMalloc(sizeof(int) * registers);
+        int* occupancy = safeMalloc(sizeof(int) * (VECTOR_SIZE(procedure->instructions) + 1));
+        computeLiveRanges(procedure, definitions, lastUses, occupancy);
+
+        for (int j = 0; j < VECTOR_SIZE(procedure->instructions); j++) {
+            Instruction* instruction = VECTOR_GET(procedure->instructions, j);
+            int added = VECTOR_SIZE(instructions);
+            // The registers live before the instruction, its operands included.
+            bool registerFree = (j == 0 ? 0 : occupancy[j - 1]) < registerCount;
+
+            switch (instruction->type) {
+                case IR_MULTIPLY:
+                case IR_DIVIDE:
+                case IR_MODULO:
+                    reduceInstruction(context, procedure, instructions, instruction, registerFree);
+                    break;
+                case IR_POWER:
+                    unrollPower(context, procedure, instructions, instruction, registerFree);
+                    break;
+            }
+
+            for (int k = added; k < VECTOR_SIZE(instructions); k++) {
+                ((Instruction*) VECTOR_GET(instructions, k))->span = instruction->span;
+            }
+
+            pushVector(instructions, instruction);
+        }
+
+        freeVector(procedure->instructions);
+        procedure->instructions = instructions;
+        free(definitions);
+        free(lastUses);
+        free(occupancy);
+    }
+}
+
+// A value computed by an earlier instruction, held by its destination.
+typedef struct {
+    Instruction* instruction;
+    int index;
+} Value;
+
+typedef struct {
+    CompilerContext* context;
+    Map* values;
+    Vector* allocated;
+    Register** replacements;
+    int* definitions;
+    int* lastUses;
+    int* occupancy;
+    int* lastStores;
+    Operand** storedValues;
+    int registerCount;
+} ValueNumbering;
+
+static bool isCommutative(InstructionType type)
+{
+    return type == IR_ADD || type == IR_MULTIPLY || type == IR_AND;
+}
+
+static bool isStore(Instruction* instruction)
+{
+    return instruction->type == IR_MOVE && ((Operand*) VECTOR_LAST(instruction->operands))->type == OPERAND_MEMORY;
+}
+
+static int getOperandKey(Operand* operand)
+{
+    switch (operand->type) {
+        case OPERAND_REGISTER:
+            return operand->value.reg->virtualNumber;
+        default:
+            return operand->value.integer;
+    }
+}
+
+static bool isSameOperand(Operand* operand1, Operand* operand2)
+{
+    if (operand1->type != operand2->type || operand1->width != operand2->width) {
+        return false;
+    }
+
+    if (operand1->type == OPERAND_REGISTER) {
+        return operand1->value.reg == operand2->value.reg;
+    }
+
+    return operand1->value.integer == operand2->value.integer;
+}
+
+// Orders the operands of a commutative operation so that a + b and b + a
+// are numbered alike: registers by number, then integers.
+static void sortOperands(Instruction* instruction)
+{
+    Operand** operands = (Operand**) instruction->operands->items;
+    Operand* first = operands[0];
+    Operand* second = operands[1];
+
+    if (
+        (first->type == OPERAND_INTEGER && second->type != OPERAND_INTEGER) ||
+        (first->type == second->type && getOperandKey(first) > getOperandKey(second))
+    ) {
+        operands[0] = second;
+        operands[1] = first;
+    }
+}
+
+// Hashes the operation and its sources; values with the same key are told
+// apart by comparing them.
+static int getValueKey(Instruction* instruction)
+{
+    uint32_t key = instruction->type;
+
+    for (int i = 0; i < VECTOR_SIZE(instruction->operands) - 1; i++) {
+        Operand* operand = VECTOR_GET(instruction->operands, i);
+        key = (key * 31 + operand->type) * 0x9E3779B1 + getOperandKey(operand);
+    }
+
+    return key;
+}
+
+static bool isSameValue(Instruction* instruction1, Instruction* instruction2)
+{
+    if (instruction1->type != instruction2->type) {
+        return false;
+    }
+
+    for (VECTOR_EACH(instruction1->operands)) {
+        Operand* operand1 = VECTOR_GET(instruction1->operands, i);
+        Operand* operand2 = VECTOR_GET(instruction2->operands, i);
+
+        if (i == VECTOR_SIZE(instruction1->operands) - 1) {
+            return operand1->width == operand2->width;
+        }
+
+        if (!isSameOperand(operand1, operand2)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// The backend has a fixed number of registers and doesn't spill, so a value
+// is only reused when keeping it alive until index never needs more: the
+// occupancy counts the registers live between each instruction and the next.
+static bool extendRegister(ValueNumbering* numbering, Register* reg, Register* replaced, int index)
+{
+    int* lastUse = &numbering->lastUses[reg->virtualNumber];
+
+    for (int point = *lastUse; point < index; point++) {
+        if (numbering->occupancy[point] >= numbering->registerCount) {
+            return false;
+        }
+    }
+
+    for (int point = *lastUse; point < index; point++) {
+        numbering->occupancy[point]++;
+    }
+
+    if (numbering->lastUses[replaced->virtualNumber] > *lastUse) {
+        *lastUse = numbering->lastUses[replaced->virtualNumber];
+    }
+
+    return true;
+}
+
+// Returns the register already holding the value computed by the
+// instruction, if keeping it alive is possible. Only the latest equal value
+// is tried, which is the cheapest to keep. A load with no earlier load since
+// the last store to its slot is answered by the register stored.
+static Register* findValue(ValueNumbering* numbering, Instruction* instruction, int index)
+{
+    Operand* destination = VECTOR_LAST(instruction->operands);
+    Operand* source = VECTOR_FIRST(instruction->operands);
+    bool load = instruction->type == IR_MOVE && source->type == OPERAND_MEMORY;
+    int key = getValueKey(instruction);
+    Vector* values = getMap(numbering->values, key);
+    Value* latest = NULL;
+
+    for (int i = values == NULL ? -1 : VECTOR_SIZE(values) - 1; i >= 0; i--) {
+        Value* value = VECTOR_GET(values, i);
+
+        if (isSameValue(value->instruction, instruction)) {
+            latest = value;
+            break;
+        }
+    }
+
+    if (load && latest != NULL && latest->index < numbering->lastStores[source->value.integer / 4]) {
+        latest = NULL;
+    }
+
+    Register* reg = NULL;
+
+    if (latest != NULL) {
+        reg = ((Operand*) VECTOR_LAST(latest->instruction->operands))->value.reg;
+    } else if (load) {
+        Operand* stored = numbering->storedValues[source->value.integer / 4];
+
+        if (stored != NULL && stored->type == OPERAND_REGISTER && stored->width == destination->width) {
+            reg = stored->value.reg;
+        }
+    }
+
+    // Loads are reused all the time and aren't worth a remark.
+    Span span = instruction->span;
+
+    if (reg != NULL && extendRegister(numbering, reg, destination->value.reg, index)) {
+        if (!load) {
+            addRemarkAt(numbering->context, REMARK_PASSED, "value-numbering", span.startIndex, span.endIndex,
+                "Reused the equal value computed before.");
+        }
+
+        return reg;
+    }
+
+    if (reg != NULL && !load) {
+        addRemarkAt(numbering->context, REMARK_MISSED, "value-numbering", span.startIndex, span.endIndex,
+            "Recomputed: keeping the equal value computed before alive would need more than %d registers.",
+            numbering->registerCount);
+    }
+
+    if (values == NULL) {
+        values = newVector();
+        pushVector(numbering->allocated, values);
+        setMap(numbering->values, key, values);
+    }
+
+    Value* value = safeMalloc(sizeof(Value));
+    value->instruction = instruction;
+    value->index = index;
+    pushVector(values, value);
+
+    return NULL;
+}
+
+static void numberProcedure(ValueNumbering* numbering, Procedure* procedure)
+{
+    int count = VECTOR_SIZE(procedure->instructions);
+    Vector* instructions = newVector();
+
+    for (int i = 0; i < count; i++) {
+        Instruction* instruction = VECTOR_GET(procedure->instructions, i);
+
+        for (int j = 0; j < VECTOR_SIZE(instruction->operands); j++) {
+            Operand* operand = VECTOR_GET(instruction->operands, j);
+
+            if (operand->type == OPERAND_REGISTER && numbering->replacements[operand->value.reg->virtualNumber] != NULL) {
+                operand->value.reg = numbering->replacements[operand->value.reg->virtualNumber];
+            }
+        }
+
+        if (isStore(instruction)) {
+            int slot = ((Operand*) VECTOR_LAST(instruction->operands))->value.integer / 4;
+            numbering->lastStores[slot] = i;
+            numbering->storedValues[slot] = VECTOR_FIRST(instruction->operands);
+        } else if (instruction->type != IR_RETURN) {
+            if (isCommutative(instruction->type)) {
+                sortOperands(instruction);
+            }
+
+            Register* reg = findValue(numbering, instruction, i);
+
+            if (reg != NULL) {
+                Operand* destination = VECTOR_LAST(instruction->operands);
+                numbering->replacements[destination->value.reg->virtualNumber] = reg;
+                freeInstruction(instruction);
+
+                continue;
+            }
+        }
+
+        pushVector(instructions, instruction);
+    }
+
+    freeVector(procedure->instructions);
+    procedure->instructions = instructions;
+}
+
+// Numbers the values computed by each procedure, which is a single basic
+// block, and replaces the instructions recomputing one with the register
+// already holding it. Variables are constant, but a load is only matched
+// with the earlier loads and the store of the same slot it follows.
+void numberValues(CompilerContext* context, IR* ir, int registerCount)
+{
+    int slotCount = ir->offset / 4 + 1;
+
+    for (VECTOR_EACH(ir->procedures)) {
+        Procedure* procedure = VECTOR_GET(ir->procedures, i);
+        int registers = procedure->nextRegisterNumber + 1;
+        ValueNumbering numbering;
+        numbering.context = context;
+        numbering.values = newMap();
+        numbering.allocated = newVector();
+        numbering.replacements = safeMalloc(sizeof(Register*) * registers);
+        numbering.definitions = safeMalloc(sizeof(int) * registers);
+        numbering.lastUses = safeMalloc(sizeof(int) * registers);
+        numbering.occupancy = safeMalloc(sizeof(int) * (VECTOR_SIZE(procedure->instructions) + 1));
+        numbering.lastStores = safeMalloc(sizeof(int) * slotCount);
+        numbering.storedValues = safeMalloc(sizeof(Operand*) * slotCount);
+        numbering.registerCount = registerCount;
+
+        for (int number = 0; number < registers; number++) {
+            numbering.replacements[number] = NULL;
+        }
+
+        for (int slot = 0; slot < slotCount; slot++) {
+            numbering.lastStores[slot] = -1;
+            numbering.storedValues[slot] = NULL;
+        }
+
+        computeLiveRanges(procedure, numbering.definitions, numbering.lastUses, numbering.occupancy);
+        numberProcedure(&numbering, procedure);
+
+        for (int j = 0; j < VECTOR_SIZE(numbering.allocated); j++) {
+            Vector* values = VECTOR_GET(numbering.allocated, j);
+
+            for (int k = 0; k < VECTOR_SIZE(values); k++) {
+                free(VECTOR_GET(values, k));
+            }
+
+            freeVector(values);
+        }
+
+        freeVector(numbering.allocated);
+        freeMap(numbering.values);
+        free(numbering.replacements);
+        free(numbering.definitions);
+        free(numbering.lastUses);
+        free(numbering.occupancy);
+        free(numbering.lastStores);
+        free(numbering.storedValues);
+    }
+}
+
+static bool isLive(bool* liveRegisters, bool* liveSlots, Operand* operand)
+{
+    switch (operand->type) {
+        case OPERAND_REGISTER:
+            return liveRegisters[operand->value.reg->virtualNumber];
+        case OPERAND_MEMORY:
+            return liveSlots[operand->value.integer / 4];
+    }
+
+    return true;
+}
+
+static void setLive(bool* liveRegisters, bool* liveSlots, Operand* operand, bool live)
+{
+    switch (operand->type) {
+        case OPERAND_REGISTER:
+            liveRegisters[operand->value.reg->virtualNumber] = live;
+            break;
+        case OPERAND_MEMORY:
+            liveSlots[operand->value.integer / 4] = live;
+            break;
+    }
+}
+
+// Walks the instructions backward keeping the registers and stack slots read
+// further down. An instruction whose destination isn't read is dropped, which
+// can make its operands dead in turn. Instructions have no effect besides
+// their destination, except the divisions still checked for zero, which are
+// kept so that they stop the program whatever the optimization level.
+static void removeDeadInstructions(CompilerContext* context, Procedure* procedure, bool* liveSlots)
+{
+    bool* liveRegisters = safeMalloc(sizeof(bool) * (procedure->nextRegisterNumber + 1));
+    memset(liveRegisters, 0, sizeof(bool) * (procedure->nextRegisterNumber + 1));
+    Vector* kept = newVector();
+
+    for (int i = VECTOR_SIZE(procedure->instructions) - 1; i >= 0; i--) {
+        Instruction* instruction = VECTOR_GET(procedure->instructions, i);
+        int sourceCount = VECTOR_SIZE(instruction->operands);
+
+        if (instruction->type != IR_RETURN) {
+            Operand* destination = VECTOR_LAST(instruction->operands);
+
+            if (!isLive(liveRegisters, liveSlots, destination) && !(instruction->checks & CHECK_ZERO)) {
+                if (destination->type == OPERAND_MEMORY) {
+                    addRemarkAt(context, REMARK_PASSED, "dead-code", instruction->span.startIndex, instruction->span.endIndex,
+                        "Removed a store nothing reads.");
+                }
+
+                freeInstruction(instruction);
+
+                continue;
+            }
+
+            setLive(liveRegisters, liveSlots, destination, false);
+            sourceCount--;
+        }
+
+        for (int j = 0; j < sourceCount; j++) {
+            setLive(liveRegisters, liveSlots, VECTOR_GET(instruction->operands, j), true);
+        }
+
+        pushVector(kept, instruction);
+    }
+
+    freeVector(procedure->instructions);
+    procedure->instructions = newVector();
+
+    for (int i = VECTOR_SIZE(kept) - 1; i >= 0; i--) {
+        pushVector(procedure->instructions, VECTOR_GET(kept, i));
+    }
+
+    freeVector(kept);
+    free(liveRegisters);
+}
+
+// Gives the slots still used consecutive offsets, so the frame only holds
+// them.
+static void compactSlots(IR* ir, int slotCount)
+{
+    int* offsets = safeMalloc(sizeof(int) * slotCount);
+
+    for (int slot = 0; slot < slotCount; slot++) {
+        offsets[slot] = -1;
+    }
+
+    int offset = 0;
+
+    for (VECTOR_EACH(ir->procedures)) {
+        Procedure* procedure = VECTOR_GET(ir->procedures, i);
+
+        for (int j = 0; j < VECTOR_SIZE(procedure->instructions); j++) {
+            Instruction* instruction = VECTOR_GET(procedure->instructions, j);
+
+            for (int k = 0; k < VECTOR_SIZE(instruction->operands); k++) {
+                Operand* operand = VECTOR_GET(instruction->operands, k);
+
+                if (operand->type != OPERAND_MEMORY) {
+                    continue;
+                }
+
+                int slot = operand->value.integer / 4;
+
+                if (offsets[slot] == -1) {
+                    offsets[slot] = offset;
+                    offset += 4;
+                }
+
+                operand->value.integer = offsets[slot];
+            }
+        }
+    }
+
+    ir->offset = offset;
+    free(offsets);
+}
+
+// Removes the computations and the stores nothing reads, then the variables
+// left without a store or a load.
+void removeDeadCode(CompilerContext* context, IR* ir)
+{
+    int slotCount = ir->offset / 4;
+    bool* liveSlots = safeMalloc(sizeof(bool) * (slotCount + 1));
+
+    for (VECTOR_EACH(ir->procedures)) {
+        memset(liveSlots, 0, sizeof(bool) * (slotCount + 1));
+        removeDeadInstructions(context, VECTOR_GET(ir->procedures, i), liveSlots);
+    }
+
+    free(liveSlots);
+    compactSlots(ir, slotCount);
+}
+
+// The values an operand may take, as a range and the low bit when it is
+// known, which proves an odd value non-zero whatever its range. Bounds are
+// computed on 64 bits and a range past 32 bits is widened to the full one,
+// as the operation may have wrapped; the low bit survives wrapping.
+typedef struct {
+    int64_t min;
+    int64_t max;
+    int lowBit;
+} Range;
+
+typedef struct {
+    Range* registers;
+    Range* slots;
+} RangeAnalysis;
+
+static Range makeRange(int64_t min, int64_t max, int lowBit)
+{
+    Range range = {min, max, lowBit};
+
+    if (min < INT32_MIN || max > INT32_MAX) {
+        range.min = INT32_MIN;
+        range.max = INT32_MAX;
+    }
+
+    return range;
+}
+
+static Range getFullRange()
+{
+    return makeRange(INT32_MIN, INT32_MAX, -1);
+}
+
+static bool mayBe(Range range, int64_t value)
+{
+    return range.min <= value && value <= range.max && (range.lowBit == -1 || range.lowBit == (value & 1));
+}
+
+static int64_t getMaxMagnitude(Range range)
+{
+    return -range.min > range.max ? -range.min : range.max;
+}
+
+// Narrower operands wrap at their own width, so nothing is assumed about
+// them.
+static Range getOperandRange(RangeAnalysis* analysis, Operand* operand)
+{
+    if (operand->width != 4) {
+        return getFullRange();
+    }
+
+    switch (operand->type) {
+        case OPERAND_INTEGER:
+            return makeRange(operand->value.integer, operand->value.integer, operand->value.integer & 1);
+        case OPERAND_REGISTER:
+            return analysis->registers[operand->value.reg->virtualNumber];
+        case OPERAND_MEMORY:
+            return analysis->slots[operand->value.integer / 4];
+    }
+
+    return getFullRange();
+}
+
+// The low bit of both a product and a conjunction is the and of theirs, which
+// is known to be zero as soon as one of them is.
+static int andLowBits(int lowBit1, int lowBit2)
+{
+    if (lowBit1 == 0 || lowBit2 == 0) {
+        return 0;
+    }
+
+    return lowBit1 == 1 && lowBit2 == 1 ? 1 : -1;
+}
+
+static Range multiplyRanges(Range range1, Range range2)
+{
+    int64_t products[] = {
+        range1.min * range2.min,
+        range1.min * range2.max,
+        range1.max * range2.min,
+        range1.max * range2.max,
+    };
+    int64_t min = products[0];
+    int64_t max = products[0];
+
+    for (int i = 1; i < 4; i++) {
+        min = products[i] < min ? products[i] : min;
+        max = products[i] > max ? products[i] : max;
+    }
+
+    int lowBit = andLowBits(range1.lowBit, range2.lowBit);
+
+    return makeRange(min, max, lowBit);
+}
+
+// Truncating division is monotonic in the dividend, so a constant divisor
+// maps the bounds. Otherwise the quotient is at most the dividend in
+// magnitude, except INT_MIN / -1 which wraps.
+static Range divideRanges(Range range1, Range range2)
+{
+    if (range2.min == range2.max && range2.min != 0) {
+        int64_t bound1 = range1.min / range2.min;
+        int64_t bound2 = range1.max / range2.min;
+
+        return makeRange(bound1 < bound2 ? bound1 : bound2, bound1 < bound2 ? bound2 : bound1, -1);
+    }
+
+    int64_t magnitude = getMaxMagnitude(range1);
+
+    return makeRange(-magnitude, magnitude, -1);
+}
+
+// The remainder takes the sign of the dividend and is smaller than the
+// divisor in magnitude. An even divisor keeps the low bit of the dividend.
+static Range moduloRanges(Range range1, Range range2)
+{
+    int64_t bound = getMaxMagnitude(range2) - 1;
+    int64_t min = range1.min > -bound ? range1.min : -bound;
+    int64_t max = range1.max < bound ? range1.max : bound;
+    int lowBit = range2.lowBit == 0 ? range1.lowBit : -1;
+
+    if (min > 0) {
+        min = 0;
+    }
+
+    if (max < 0) {
+        max = 0;
+    }
+
+    return makeRange(min, max, lowBit);
+}
+
+// Shift counts are always immediates.
+static Range shiftRange(InstructionType type, Range range, int count)
+{
+    switch (type) {
+        case IR_SHIFT_LEFT:
+            return makeRange(range.min * ((int64_t) 1 << count), range.max * ((int64_t) 1 << count), count > 0 ? 0 : range.lowBit);
+        case IR_SHIFT_RIGHT:
+            return makeRange(range.min >> count, range.max >> count, -1);
+        default:
+            if (range.min >= 0) {
+                return makeRange(range.min >> count, range.max >> count, -1);
+            }
+
+            return count > 0 ? makeRange(0, UINT32_MAX >> count, -1) : getFullRange();
+    }
+}
+
+// Anding with a value that isn't negative gives a value between zero and it.
+static Range andRanges(Range range1, Range range2)
+{
+    int lowBit = andLowBits(range1.lowBit, range2.lowBit);
+
+    if (range1.min >= 0 && range2.min >= 0) {
+        return makeRange(0, range1.max < range2.max ? range1.max : range2.max, lowBit);
+    }
+
+    if (range1.min >= 0 || range2.min >= 0) {
+        return makeRange(0, range1.min >= 0 ? range1.max : range2.max, lowBit);
+    }
+
+    return makeRange(INT32_MIN, INT32_MAX, lowBit);
+}
+
+static Range getInstructionRange(RangeAnalysis* analysis, Instruction* instruction)
+{
+    Range range1 = getOperandRange(analysis, VECTOR_GET(instruction->operands, 0));
+    Range range2 = VECTOR_SIZE(instruction->operands) > 2 ? getOperandRange(analysis, VECTOR_GET(instruction->operands, 1)) : range1;
+    int lowBit = range1.lowBit == -1 || range2.lowBit == -1 ? -1 : range1.lowBit ^ range2.lowBit;
+
+    switch (instruction->type) {
+        case IR_MOVE:
+            return range1;
+        case IR_ADD:
+            return makeRange(range1.min + range2.min, range1.max + range2.max, lowBit);
+        case IR_SUBSTRACT:
+            return makeRange(range1.min - range2.max, range1.max - range2.min, lowBit);
+        case IR_NEGATE:
+            return makeRange(-range1.max, -range1.min, range1.lowBit);
+        case IR_MULTIPLY:
+            return multiplyRanges(range1, range2);
+        case IR_DIVIDE:
+            return divideRanges(range1, range2);
+        case IR_MODULO:
+            return moduloRanges(range1, range2);
+        case IR_SHIFT_LEFT:
+        case IR_SHIFT_RIGHT:
+        case IR_SHIFT_RIGHT_LOGICAL:
+            return shiftRange(instruction->type, range1, ((Operand*) VECTOR_GET(instruction->operands, 1))->value.integer);
+        case IR_AND:
+            return andRanges(range1, range2);
+        default:
+            return getFullRange();
+    }
+}
+
+static void setOperandRange(RangeAnalysis* analysis, Operand* operand, Range range)
+{
+    if (operand->width != 4) {
+        range = getFullRange();
+    }
+
+    switch (operand->type) {
+        case OPERAND_REGISTER:
+            analysis->registers[operand->value.reg->virtualNumber] = range;
+            break;
+        case OPERAND_MEMORY:
+            analysis->slots[operand->value.integer / 4] = range;
+            break;
+    }
+}
+
+// A power only divides when its exponent is negative, and then divides one
+// by its base, which can't overflow.
+static int getNeededChecks(RangeAnalysis* analysis, Instruction* instruction)
+{
+    Range range1 = getOperandRange(analysis, VECTOR_GET(instruction->operands, 0));
+    Range range2 = getOperandRange(analysis, VECTOR_GET(instruction->operands, 1));
+    int checks = 0;
+
+    if (instruction->type == IR_POWER) {
+        return mayBe(range1, 0) && range2.min < 0 ? CHECK_ZERO : 0;
+    }
+
+    if (mayBe(range2, 0)) {
+        checks |= CHECK_ZERO;
+    }
+
+    if (mayBe(range2, -1) && mayBe(range1, INT32_MIN)) {
+        checks |= CHECK_OVERFLOW;
+    }
+
+    return checks;
+}
+
+// Reports each of the checks the instruction had, as removed or kept.
+static void reportChecks(CompilerContext* context, Instruction* instruction, int checks)
+{
+    Span span = instruction->span;
+    char* operation = instruction->type == IR_DIVIDE ? "Division" : instruction->type == IR_MODULO ? "Modulo" : "Power";
+
+    if (checks & CHECK_ZERO && instruction->checks & CHECK_ZERO) {
+        addRemarkAt(context, REMARK_MISSED, "division-checks", span.startIndex, span.endIndex,
+            "%s checked at runtime: the %s may be zero.", operation, instruction->type == IR_POWER ? "base" : "divisor");
+    } else if (checks & CHECK_ZERO) {
+        addRemarkAt(context, REMARK_PASSED, "division-checks", span.startIndex, span.endIndex,
+            "%s check removed: it can't divide by zero.", operation);
+    }
+
+    if (checks & CHECK_OVERFLOW && instruction->checks & CHECK_OVERFLOW) {
+        addRemarkAt(context, REMARK_MISSED, "division-checks", span.startIndex, span.endIndex,
+            "%s checked at runtime: it may divide INT_MIN by -1.", operation);
+    } else if (checks & CHECK_OVERFLOW) {
+        addRemarkAt(context, REMARK_PASSED, "division-checks", span.startIndex, span.endIndex,
+            "%s overflow check removed: it can't divide INT_MIN by -1.", operation);
+    }
+}
+
+// Follows the values each procedure computes, which is a single basic block,
+// to remove the checks of the divisions that can't divide by zero or divide
+// INT_MIN by -1. There are
+// no branches to guard a value, so only literals and the arithmetic on them
+// narrow a range. Uninitialized variables may hold anything. This runs
+// before strength reduction, as the range of a remainder is lost once it is
+// computed with shifts and a mask.
+void removeDivisionChecks(CompilerContext* context, IR* ir)
+{
+    int slotCount = ir->offset / 4 + 1;
+    RangeAnalysis analysis;
+    analysis.slots = safeMalloc(sizeof(Range) * slotCount);
+
+    for (VECTOR_EACH(ir->procedures)) {
+        Procedure* procedure = VECTOR_GET(ir->procedures, i);
+        analysis.registers = safeMalloc(sizeof(Range) * (procedure->nextRegisterNumber + 1));
+
+        for (int number = 0; number <= procedure->nextRegisterNumber; number++) {
+            analysis.registers[number] = getFullRange();
+        }
+
+        for (int slot = 0; slot < slotCount; slot++) {
+            analysis.slots[slot] = getFullRange();
+        }
+
+        for (int j = 0; j < VECTOR_SIZE(procedure->instructions); j++) {
+            Instruction* instruction = VECTOR_GET(procedure->instructions, j);
+
+            if (instruction->type == IR_RETURN) {
+                continue;
+            }
+
+            if (instruction->checks) {
+                int checks = instruction->checks;
+                instruction->checks &= getNeededChecks(&analysis, instruction);
+                reportChecks(context, instruction, checks);
+            }
+
+            setOperandRange(&analysis, VECTOR_LAST(instruction->operands), getInstructionRange(&analysis, instruction));
+        }
+
+        free(analysis.registers);
+    }
+
+    free(analysis.slots);
+}
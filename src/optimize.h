@@ -0,0 +1,11 @@
+#ifndef OPAL_OPTIMIZE_H
+#define OPAL_OPTIMIZE_H
+
+#include "ir.h"
+
+void reduceStrength(CompilerContext* context, IR* ir, int registerCount);
+void numberValues(CompilerContext* context, IR* ir, int registerCount);
+void removeDeadCode(CompilerContext* context, IR* ir);
+void removeDivisionChecks(CompilerContext* context, IR* ir);
+
+#endif
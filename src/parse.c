@@ -2,20 +2,17 @@
 #include "util.h"
 #include "scan.h"
 #include "error.h"
-#include <math.h>
+#include "remark.h"
+#include <limits.h>
+#include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
 #include "symbol.h"
+#include "intern.h"
+#include "arena.h"
 
-#define TYPE_INTEGER "<integer>"
-#define TYPE_BOOLEAN "<boolean>"
-#define TYPE_NULL "<null>"
-
-typedef struct {
-    Module* module;
-    int index;
-    Vector* tokens;
-    Environment* environment;
-} Parser;
+#define PARSER_FRAMES_INITIAL_CAPACITY 64
+#define NODE_PENDING (NODE_NONE - 1)
 
 typedef enum {
     PRECEDENCE_NONE,
@@ -31,8 +28,38 @@ typedef enum {
     PRECEDENCE_CALL,        // . ()
 } Precedence;
 
-typedef Node* (*PrefixParseFunction)();
-typedef Node* (*InfixParseFunction)(Node* left);
+typedef enum {
+    FRAME_BINARY,
+    FRAME_UNARY,
+    FRAME_GROUPING
+} FrameType;
+
+// An operand whose parsing was suspended to parse a nested expression
+// first. The frame keeps what is needed to finish it and the precedence of
+// the expression it belongs to.
+typedef struct {
+    FrameType type;
+    Precedence precedence;
+    NodeIndex left;
+    Token* token;
+} Frame;
+
+typedef struct {
+    CompilerContext* context;
+    size_t index;
+    TokenBuffer* tokens;
+    Environment* environment;
+    Ast* ast;
+    Frame* frames;
+    int frameCount;
+    int frameCapacity;
+    int depth;
+    Precedence precedence;
+    bool tooDeep;
+} Parser;
+
+typedef NodeIndex (*PrefixParseFunction)(Parser* parser);
+typedef NodeIndex (*InfixParseFunction)(Parser* parser, NodeIndex left);
 
 typedef struct {
     Precedence precedence;
@@ -40,13 +67,11 @@ typedef struct {
     InfixParseFunction infix;
 } ParseRule;
 
-Parser* parser;
-
-static Node* binary(Node* left);
-static Node* primary();
-static Node* grouping();
-static Node* unary();
-static Node* variable();
+static NodeIndex binary(Parser* parser, NodeIndex left);
+static NodeIndex primary(Parser* parser);
+static NodeIndex grouping(Parser* parser);
+static NodeIndex unary(Parser* parser);
+static NodeIndex variable(Parser* parser);
 
 ParseRule rules[] = {
     [TOKEN_PLUS]                = {PRECEDENCE_TERM, NULL, binary},
@@ -108,48 +133,56 @@ ParseRule rules[] = {
     [TOKEN_EOF]                 = {PRECEDENCE_NONE, NULL, NULL},
 };
 
-static Token* peekAt(int index)
+static Token* peekAt(Parser* parser, size_t index)
 {
-    return (Token*) VECTOR_GET(parser->tokens, index);
+    TokenBuffer* tokens = parser->tokens;
+
+    if (index >= tokens->size - tokens->tailSize) {
+        moveTokenGap(tokens, index + 1);
+    }
+
+    return &tokens->tokens[index];
 }
 
-static Token* peek()
+static Token* peek(Parser* parser)
 {
-    return peekAt(parser->index);
+    return peekAt(parser, parser->index);
 }
 
-static Token* peekNext()
+static Token* peekNext(Parser* parser)
 {
-    return peekAt(parser->index + 1);
+    return peekAt(parser, parser->index + 1);
 }
 
-static void back()
+static void back(Parser* parser)
 {
     parser->index--;
 }
 
-static Node* makeNode(NodeType type, int startIndex, int endIndex)
+static NodeIndex makeNode(Parser* parser, NodeType type, size_t startIndex, size_t endIndex)
 {
-    Node* node = safeMalloc(sizeof(Node));
-    node->type = type;
-    node->startIndex = startIndex;
-    node->endIndex = endIndex;
-
-    return node;
+    return addAstNode(parser->ast, type, startIndex, endIndex);
 }
 
-static Parser* newParser(Module* module, Vector* tokens)
+static Parser* newParser(CompilerContext* context, TokenBuffer* tokens, Ast* ast, Environment* environment)
 {
     Parser* parser = safeMalloc(sizeof(Parser));
-    parser->module = module;
+    parser->context = context;
     parser->tokens = tokens;
     parser->index = 0;
-    parser->environment = newEnvironment();
+    parser->environment = environment;
+    parser->ast = ast;
+    parser->frames = safeMalloc(sizeof(Frame) * PARSER_FRAMES_INITIAL_CAPACITY);
+    parser->frameCount = 0;
+    parser->frameCapacity = PARSER_FRAMES_INITIAL_CAPACITY;
+    parser->depth = 0;
+    parser->precedence = PRECEDENCE_NONE;
+    parser->tooDeep = false;
 
     return parser;
 }
 
-static void advance()
+static void advance(Parser* parser)
 {
     parser->index++;
 }
@@ -159,80 +192,131 @@ static ParseRule* getRule(TokenType type)
     return &rules[type];
 }
 
-static void addErrorAtToken(Token* token, char* message)
+static void addErrorAtToken(Parser* parser, Token* token, char* message, ...)
 {
-    addErrorAt(parser->module, token->startIndex, token->endIndex, message);
+    va_list args;
+    va_start(args, message);
+    char* text = formatArguments(message, args);
+    va_end(args);
+    addErrorAt(parser->context, token->startIndex, TOKEN_END_INDEX(token), "%s", text);
+    free(text);
 }
 
-static bool isAtEnd()
+static bool isAtEnd(Parser* parser)
 {
-    return VECTOR_SIZE(parser->tokens) <= parser->index + 1;
+    return parser->tokens->size <= parser->index + 1;
 }
 
-static Node* parsePrecedence(Precedence precedence)
+// Suspends the operand being parsed until the expression starting at the
+// next token is complete. Binary frames are bounded by the number of
+// precedence levels, so only unary operators and parentheses count towards
+// the nesting limit.
+static NodeIndex pushFrame(Parser* parser, FrameType type, Precedence precedence, NodeIndex left)
 {
-    PrefixParseFunction prefixFunction = getRule(peek()->type)->prefix;
+    if (type != FRAME_BINARY && parser->depth++ == parser->context->maxNestingDepth) {
+        addErrorAtToken(parser, peek(parser), "Expression is nested too deeply, the limit is %d.", parser->context->maxNestingDepth);
+        parser->tooDeep = true;
 
-    if (prefixFunction == NULL) {
-        addErrorAtToken(peek(), "Expect an expression.");
-
-        return NULL;
+        return NODE_NONE;
     }
 
-    Node* node = prefixFunction();
-
-    if (isAtEnd()) {
-        return node;
+    if (parser->frameCount == parser->frameCapacity) {
+        parser->frameCapacity *= 2;
+        parser->frames = safeRealloc(parser->frames, sizeof(Frame) * parser->frameCapacity);
     }
 
-    while (precedence <= getRule(peekNext()->type)->precedence) {
-        advance();
-        InfixParseFunction infixFunction = getRule(peek()->type)->infix;
-        node = infixFunction(node);
-        
-        if (isAtEnd()) {
-            return node;
-        }
-    }
+    Frame* frame = &parser->frames[parser->frameCount++];
+    frame->type = type;
+    frame->precedence = parser->precedence;
+    frame->left = left;
+    frame->token = peek(parser);
+    parser->precedence = precedence;
+    advance(parser);
 
-    return node;
+    return NODE_PENDING;
 }
 
-static Node* primary()
+static NodeIndex popFrame(Parser* parser, NodeIndex node);
+
+// Prefix and infix functions either return a complete operand or push a
+// frame and return NODE_PENDING, so the nesting depth of the input only
+// grows the frame stack and never the C stack.
+static NodeIndex parsePrecedence(Parser* parser, Precedence precedence)
 {
-    Token* token = peek();
+    int base = parser->frameCount;
+    Precedence outer = parser->precedence;
+    parser->precedence = precedence;
+
+    while (true) {
+        PrefixParseFunction prefixFunction = getRule(peek(parser)->type)->prefix;
+        bool parsed = prefixFunction != NULL;
+        NodeIndex node = NODE_NONE;
+
+        if (parsed) {
+            node = prefixFunction(parser);
+        } else {
+            addErrorAtToken(parser, peek(parser), "Expect an expression.");
+        }
 
-    switch (token->type) {
-        case TOKEN_INTEGER: {
-            Node* node = makeNode(NODE_INTEGER, token->startIndex, token->endIndex);
-            node->children.integer = token->value.integer;
-            node->valueType = TYPE_INTEGER;
+        while (node != NODE_PENDING && !parser->tooDeep) {
+            if (parsed && !isAtEnd(parser) && parser->precedence <= getRule(peekNext(parser)->type)->precedence) {
+                advance(parser);
+                InfixParseFunction infixFunction = getRule(peek(parser)->type)->infix;
+                node = infixFunction(parser, node);
 
-            return node;
-        }
-        case TOKEN_FALSE: {
-            Node* node = makeNode(NODE_BOOLEAN, token->startIndex, token->endIndex);
-            node->children.boolean = false;
-            node->valueType = TYPE_BOOLEAN;
+                continue;
+            }
 
-            return node;
-        }
-        case TOKEN_TRUE: {
-            Node* node = makeNode(NODE_BOOLEAN, token->startIndex, token->endIndex);
-            node->children.boolean = true;
-            node->valueType = TYPE_BOOLEAN;
+            if (parser->frameCount == base) {
+                parser->precedence = outer;
+
+                return node;
+            }
 
-            return node;
+            node = popFrame(parser, node);
+            parsed = true;
         }
-        case TOKEN_NULL: {
-            Node* node = makeNode(NODE_NULL, token->startIndex, token->endIndex);
-            node->valueType = TYPE_NULL;
 
-            return node;
+        if (parser->tooDeep) {
+            parser->frameCount = base;
+            parser->precedence = outer;
+
+            return NODE_NONE;
         }
     }
 }
 
+static NodeIndex makeValue(Parser* parser, NodeType type, Token* token, int value, TypeId valueType)
+{
+    NodeIndex node = makeNode(parser, type, token->startIndex, TOKEN_END_INDEX(token));
+    parser->ast->values[node] = value;
+    parser->ast->valueTypes[node] = valueType;
+
+    return node;
+}
+
+static NodeIndex primary(Parser* parser)
+{
+    Token* token = peek(parser);
+
+    switch (token->type) {
+        case TOKEN_INTEGER:
+            if (token->value.integer > INT_MAX) {
+                addErrorAtToken(parser, token, "Integer literal is too large for type \"%s\".", getTypeName(parser->context->types, TYPE_INTEGER));
+            }
+
+            return makeValue(parser, NODE_INTEGER, token, token->value.integer, TYPE_INTEGER);
+        case TOKEN_FALSE:
+            return makeValue(parser, NODE_BOOLEAN, token, false, TYPE_BOOLEAN);
+        case TOKEN_TRUE:
+            return makeValue(parser, NODE_BOOLEAN, token, true, TYPE_BOOLEAN);
+        case TOKEN_NULL:
+            return makeValue(parser, NODE_NULL, token, 0, TYPE_NULL);
+    }
+
+    return NODE_NONE;
+}
+
 static NodeType arithmeticOperation(Token* token)
 {
     switch (token->type) {
@@ -251,334 +335,755 @@ static NodeType arithmeticOperation(Token* token)
     }
 }
 
-static Token* last()
+static Token* last(Parser* parser)
 {
-    return VECTOR_LAST(parser->tokens);
+    return peekAt(parser, parser->tokens->size - 1);
 }
 
-static void consume(TokenType type, char* message)
+static void consume(Parser* parser, TokenType type, char* message)
 {
-    if (isAtEnd()) {
-        addErrorAtToken(last(), message);
-        back();
+    if (isAtEnd(parser)) {
+        addErrorAtToken(parser, last(parser), message);
+        back(parser);
 
         return;
     }
 
-    Token* token = peek();
+    Token* token = peek(parser);
 
     if (token->type != type) {
-        addErrorAtToken(token, message);
-        back();
+        addErrorAtToken(parser, token, message);
+        back(parser);
     }
 }
 
-static bool isSameType(Node* node, char* type)
+static void checkTypes(Parser* parser, NodeIndex node)
 {
-    return !strcmp(node->valueType, type);
-}
-
-static void checkTypes(Node* node)
-{
-    Node* left = node->children.left;
-    Node* right = node->children.right;
+    Ast* ast = parser->ast;
+    TypeId left = ast->valueTypes[ast->left[node]];
+    TypeId right = ast->valueTypes[ast->right[node]];
     
-    if (left->valueType == NULL || right->valueType == NULL) {
+    if (left == TYPE_NONE || right == TYPE_NONE) {
         return;
     }
 
-    if (!isSameType(left, TYPE_INTEGER) || !isSameType(right, TYPE_INTEGER)) {
-        addErrorAt(parser->module, node->startIndex, node->endIndex, "Types \"%s\" and \"%s\" are incompatible in a binary operation.", left->valueType, right->valueType);
+    if (left != TYPE_INTEGER || right != TYPE_INTEGER) {
+        Span span = ast->spans[node];
+        addErrorAt(parser->context, span.startIndex, span.endIndex, "Types \"%s\" and \"%s\" are incompatible in a binary operation.", getTypeName(parser->context->types, left), getTypeName(parser->context->types, right));
 
         return;
     }
 
-    node->valueType = TYPE_INTEGER;
+    ast->valueTypes[node] = TYPE_INTEGER;
 }
 
-static Node* binary(Node* left)
+static NodeIndex binary(Parser* parser, NodeIndex left)
 {
-    Token* token = peek();
-    printf("%d\n", left == NULL);
-    NodeType type = arithmeticOperation(token);
-    advance();
-    ParseRule* rule = getRule(token->type);
-    Node* right = parsePrecedence(rule->precedence + 1);
+    return pushFrame(parser, FRAME_BINARY, getRule(peek(parser)->type)->precedence + 1, left);
+}
 
-    if (right == NULL) {
+static NodeIndex finishBinary(Parser* parser, Token* token, NodeIndex left, NodeIndex right)
+{
+    if (left == NODE_NONE || right == NODE_NONE) {
         return left;
     }
 
-    Node* node = makeNode(type, left->startIndex, right->endIndex);
-    node->children.left = left;
-    node->children.right = right;
-    checkTypes(node);
+    Ast* ast = parser->ast;
+    NodeIndex node = makeNode(parser, arithmeticOperation(token), ast->spans[left].startIndex, ast->spans[right].endIndex);
+    ast->left[node] = left;
+    ast->right[node] = right;
+    checkTypes(parser, node);
 
     return node;
 }
 
-static Node* expression()
+static NodeIndex expression(Parser* parser)
 {
-    Node* node = parsePrecedence(PRECEDENCE_ASSIGNMENT);
+    return parsePrecedence(parser, PRECEDENCE_ASSIGNMENT);
 }
 
-static Node* unary()
+static NodeIndex unary(Parser* parser)
 {
-    int startIndex = peek()->startIndex;
-    advance();
-    Node* inner = parsePrecedence(PRECEDENCE_UNARY);
-    Node* node = makeNode(NODE_NEGATE, startIndex, inner->endIndex);
-    node->children.node = inner;
+    return pushFrame(parser, FRAME_UNARY, PRECEDENCE_UNARY, NODE_NONE);
+}
+
+static NodeIndex finishUnary(Parser* parser, Token* token, NodeIndex inner)
+{
+    if (inner == NODE_NONE) {
+        return NODE_NONE;
+    }
+
+    Ast* ast = parser->ast;
+    NodeIndex node = makeNode(parser, NODE_NEGATE, token->startIndex, ast->spans[inner].endIndex);
+    ast->left[node] = inner;
 
     return node;
 }
 
-static Node* grouping()
+static NodeIndex grouping(Parser* parser)
+{
+    return pushFrame(parser, FRAME_GROUPING, PRECEDENCE_ASSIGNMENT, NODE_NONE);
+}
+
+static NodeIndex finishGrouping(Parser* parser, Token* token, NodeIndex node)
 {
-    int startIndex = peek()->startIndex;
-    advance();
-    Node* node = expression();
-    node->startIndex = startIndex;
-    advance();
-    consume(TOKEN_RIGHT_PAREN, "Expect \")\" after an expression.");
-    node->endIndex = peek()->endIndex;
+    advance(parser);
+    consume(parser, TOKEN_RIGHT_PAREN, "Expect \")\" after an expression.");
+
+    if (node != NODE_NONE) {
+        parser->ast->spans[node].startIndex = token->startIndex;
+        parser->ast->spans[node].endIndex = TOKEN_END_INDEX(peek(parser));
+    }
 
     return node;
 }
 
-static Node* declaration()
+static NodeIndex popFrame(Parser* parser, NodeIndex node)
 {
-    Token* first = peek();
-    advance();
-    consume(TOKEN_IDENTIFIER, "Expect an identifier to declare a constant.");
-    char* identifier = peek()->value.string;
-    Token* last = peek();
-    Node* value;
+    Frame* frame = &parser->frames[--parser->frameCount];
+    parser->precedence = frame->precedence;
+    parser->depth -= frame->type != FRAME_BINARY;
+
+    switch (frame->type) {
+        case FRAME_BINARY:
+            return finishBinary(parser, frame->token, frame->left, node);
+        case FRAME_UNARY:
+            return finishUnary(parser, frame->token, node);
+        case FRAME_GROUPING:
+            return finishGrouping(parser, frame->token, node);
+    }
 
-    if (peekNext()->type == TOKEN_EQUAL) {
-        advance();
-        advance();
-        value = expression();
+    return NODE_NONE;
+}
 
-        if (value == NULL) {
-            back();
+static NodeIndex declaration(Parser* parser)
+{
+    Token* first = peek(parser);
+    advance(parser);
+    consume(parser, TOKEN_IDENTIFIER, "Expect an identifier to declare a constant.");
+    bool named = peek(parser)->type == TOKEN_IDENTIFIER;
+    int identifier = named ? peek(parser)->value.identifier : -1;
+    Token* last = peek(parser);
+    NodeIndex value = NODE_NONE;
+
+    if (peekNext(parser)->type == TOKEN_EQUAL) {
+        advance(parser);
+        advance(parser);
+        value = expression(parser);
+
+        if (value == NODE_NONE) {
+            back(parser);
         }
 
-        last = peek();
+        last = peek(parser);
     }
 
-    Variable* variable = newEnvironmentVariable(parser->environment, identifier, value != NULL ? value->valueType : NULL);
+    Ast* ast = parser->ast;
+    NodeIndex node = makeNode(parser, NODE_ASSIGNMENT, first->startIndex, TOKEN_END_INDEX(last));
+    ast->left[node] = value;
+    ast->values[node] = identifier;
+    ast->valueTypes[node] = value != NODE_NONE ? ast->valueTypes[value] : TYPE_NONE;
 
-    Node* node = makeNode(NODE_ASSIGNMENT, first->startIndex, last->endIndex);
-    node->children.variableAssignment = variable;
-    node->children.variableValue = value;
+    if (named) {
+        newEnvironmentVariable(parser->environment, identifier, ast->valueTypes[node], node);
+    }
 
     return node;
 }
 
-static Node* statement()
+static NodeIndex statement(Parser* parser)
 {
-    Token* token = peek();
-    Node* node;
+    Token* token = peek(parser);
+    NodeIndex node;
 
     switch (token->type) {
         case TOKEN_CONST:
-            node = declaration();
+            node = declaration(parser);
             break;
         default:
-            node = expression();
+            node = expression(parser);
     }
 
-    advance();
-    consume(TOKEN_SEMILICON, "Expect \";\" after a statement.");
+    if (parser->tooDeep) {
+        return NODE_NONE;
+    }
+
+    advance(parser);
+    consume(parser, TOKEN_SEMILICON, "Expect \";\" after a statement.");
 
-    if (node == NULL) {
-        return NULL;
+    if (node == NODE_NONE) {
+        return NODE_NONE;
     }
 
-    token = isAtEnd() ? last() : peek();
-    node->endIndex = token->endIndex;
+    token = isAtEnd(parser) ? last(parser) : peek(parser);
+    parser->ast->spans[node].endIndex = TOKEN_END_INDEX(token);
 
     return node;
 }
 
-static Node* variable()
+static NodeIndex variable(Parser* parser)
 {
-    Token* token = peek();
-    char* identifier = token->value.string;
+    Token* token = peek(parser);
+    int identifier = token->value.identifier;
     Variable* variable = getEnvironmentVariable(parser->environment, identifier);
 
     if (variable == NULL) {
-        addErrorAtToken(token, format("Undefined variable \"%s\".", identifier));
+        addErrorAtToken(parser, token, "Undefined variable \"%s\".", getIdentifierName(parser->context->identifiers, identifier));
 
-        return NULL;
+        return NODE_NONE;
     }
 
-    Node* node = makeNode(NODE_LOAD, token->startIndex, token->endIndex);
-    node->children.variable = variable;
-    node->valueType = variable->type;
+    NodeIndex node = makeValue(parser, NODE_LOAD, token, identifier, variable->type);
+    parser->ast->left[node] = variable->declaration;
 
     return node;
 }
 
-void freeParser()
+static void freeParser(Parser* parser)
 {
-    freeEnvironment(parser->environment);
+    free(parser->frames);
     free(parser);
 }
 
-Node* parse(Module* module, Vector* tokens)
+// Every node consumes at least one token, so the token count bounds the
+// node count and the columns never have to grow while parsing.
+Ast* parse(CompilerContext* context, TokenBuffer* tokens)
 {
-    parser = newParser(module, tokens);
-    Vector* statements = newVector();
-
-    while (!isAtEnd()) {
-        pushVector(statements, statement());
-        advance();
+    Ast* ast = newAst(context->arena, tokens->size + 1);
+    Environment* environment = newEnvironment();
+    Parser* parser = newParser(context, tokens, ast, environment);
+    NodeIndex* statements = safeMalloc(sizeof(NodeIndex) * tokens->size);
+    uint32_t count = 0;
+    bool complete = true;
+
+    while (!isAtEnd(parser) && !parser->tooDeep) {
+        NodeIndex node = statement(parser);
+        complete = complete && node != NODE_NONE;
+        statements[count++] = node;
+        advance(parser);
     }
 
-    freeParser();
-    Node* first = VECTOR_FIRST(statements);
-    Node* last = VECTOR_LAST(statements);
-    
-    if (first == NULL || last == NULL) {
-        return NULL;
+    if (count > 0 && complete) {
+        NodeIndex first = statements[0];
+        NodeIndex last = statements[count - 1];
+        ast->root = makeNode(parser, NODE_STATEMENTS, ast->spans[first].startIndex, ast->spans[last].endIndex);
+        ast->left[ast->root] = addAstList(ast, statements, count);
+        ast->right[ast->root] = count;
     }
 
-    Node* node = makeNode(NODE_STATEMENTS, first->startIndex, last->endIndex);
-    node->children.nodes = statements;
+    free(statements);
+    freeParser(parser);
+    freeEnvironment(environment);
+
+    return ast;
+}
+
+// Parses the statement starting at *index and moves *index to the next
+// one. Parsing depends only on the position and on the declarations
+// visible through the environment, which lets callers parse statements
+// again on their own. After a too deeply nested expression *index is moved
+// to the end, as parse stops there.
+NodeIndex parseStatement(CompilerContext* context, TokenBuffer* tokens, Ast* ast, Environment* environment, size_t* index)
+{
+    Parser* parser = newParser(context, tokens, ast, environment);
+    parser->index = *index;
+    NodeIndex node = statement(parser);
+    advance(parser);
+    *index = parser->tooDeep ? tokens->size - 1 : parser->index;
+    freeParser(parser);
 
     return node;
 }
 
-void freeNode(Node* node)
+static void foldNegate(Ast* ast, NodeIndex node)
+{
+    NodeIndex inner = ast->left[node];
+
+    if (ast->types[inner] != NODE_INTEGER) {
+        return;
+    }
+
+    ast->values[node] = -(unsigned int) ast->values[inner];
+    ast->simplified[node] = ast->simplified[inner];
+    ast->types[node] = NODE_INTEGER;
+    ast->types[inner] = NODE_FOLDED;
+}
+
+// Arithmetic wraps around like the generated code, so folding never
+// overflows. The quotient of INT_MIN by -1 wraps to INT_MIN as well. A zero
+// divisor that simplification produced is left to the runtime check, as it
+// is at -O0.
+static void foldBinary(CompilerContext* context, Ast* ast, NodeIndex node)
 {
-    switch (node->type) {
+    NodeIndex left = ast->left[node];
+    NodeIndex right = ast->right[node];
+
+    if (ast->types[left] != NODE_INTEGER || ast->types[right] != NODE_INTEGER) {
+        return;
+    }
+
+    int leftValue = ast->values[left];
+    int rightValue = ast->values[right];
+    Span rightSpan = ast->spans[right];
+    int value;
+
+    switch (ast->types[node]) {
         case NODE_ADD:
+            value = (unsigned int) leftValue + rightValue;
+            break;
         case NODE_SUBSTRACT:
+            value = (unsigned int) leftValue - rightValue;
+            break;
         case NODE_MULTIPLY:
+            value = (unsigned int) leftValue * rightValue;
+            break;
         case NODE_DIVIDE:
+            if (rightValue == 0) {
+                if (!ast->simplified[right]) {
+                    addErrorAt(context, rightSpan.startIndex, rightSpan.endIndex, "Can't divide per zero.");
+                }
+
+                return;
+            }
+
+            value = rightValue == -1 ? -(unsigned int) leftValue : leftValue / rightValue;
+            break;
         case NODE_MODULO:
+            if (rightValue == 0) {
+                if (!ast->simplified[right]) {
+                    addErrorAt(context, rightSpan.startIndex, rightSpan.endIndex, "Can't modulo per zero.");
+                }
+
+                return;
+            }
+
+            value = rightValue == -1 ? 0 : leftValue % rightValue;
+            break;
         case NODE_POWER:
-            freeNode(node->children.left);
-            freeNode(node->children.right);
+            if (leftValue == 0 && rightValue < 0) {
+                if (!ast->simplified[left]) {
+                    addErrorAt(context, rightSpan.startIndex, rightSpan.endIndex, "Can't raise zero to a negative power.");
+                }
+
+                return;
+            }
+
+            value = raiseInteger(leftValue, rightValue);
             break;
-        case NODE_NEGATE:
-            freeNode(node->children.node);
+    }
+
+    ast->types[node] = NODE_INTEGER;
+    ast->values[node] = value;
+    ast->simplified[node] = ast->simplified[left] || ast->simplified[right];
+    ast->types[left] = NODE_FOLDED;
+    ast->types[right] = NODE_FOLDED;
+}
+
+// Returns the first node of the subtree rooted at node: post-order keeps a
+// subtree contiguous, and so are the subtrees of its children. Their ranges
+// don't overlap, so the child with the lower index holds the first node,
+// even after simplifyBinary swapped the operands.
+static NodeIndex getFirstNode(Ast* ast, NodeIndex node)
+{
+    while (true) {
+        switch (ast->types[node]) {
+            case NODE_ADD:
+            case NODE_SUBSTRACT:
+            case NODE_MULTIPLY:
+            case NODE_DIVIDE:
+            case NODE_MODULO:
+            case NODE_POWER:
+                node = ast->left[node] < ast->right[node] ? ast->left[node] : ast->right[node];
+                break;
+            case NODE_NEGATE:
+                node = ast->left[node];
+                break;
+            default:
+                return node;
+        }
+    }
+}
+
+static void removeSubtree(Ast* ast, NodeIndex node)
+{
+    for (NodeIndex child = getFirstNode(ast, node); child <= node; child++) {
+        ast->types[child] = NODE_FOLDED;
+    }
+}
+
+// Moves the operation of by, which precedes node, into node. Its span goes
+// along, so that remarks and runtime errors point to the same code at every
+// level.
+static void replaceNode(Ast* ast, NodeIndex node, NodeIndex by)
+{
+    ast->types[node] = ast->types[by];
+    ast->valueTypes[node] = ast->valueTypes[by];
+    ast->left[node] = ast->left[by];
+    ast->right[node] = ast->right[by];
+    ast->values[node] = ast->values[by];
+    ast->simplified[node] = ast->simplified[by];
+    ast->spans[node] = ast->spans[by];
+    ast->types[by] = NODE_FOLDED;
+}
+
+static bool isNonZeroInteger(Ast* ast, NodeIndex node)
+{
+    return ast->types[node] == NODE_INTEGER && ast->values[node] != 0;
+}
+
+// Whether one of the nodes in [start, end] may stop the program, which any
+// division or modulo by something else than a literal other than zero does
+// when it divides by zero, as does a power whose base may be zero and
+// exponent negative. These are the divisions generateIR checks.
+static bool mayTrap(Ast* ast, NodeIndex start, NodeIndex end)
+{
+    for (NodeIndex node = start; node <= end; node++) {
+        NodeIndex left = ast->left[node];
+        NodeIndex right = ast->right[node];
+
+        switch (ast->types[node]) {
+            case NODE_DIVIDE:
+            case NODE_MODULO:
+                if (!isNonZeroInteger(ast, right)) {
+                    return true;
+                }
+
+                break;
+            case NODE_POWER:
+                if (!isNonZeroInteger(ast, left) && !(ast->types[right] == NODE_INTEGER && ast->values[right] >= 0)) {
+                    return true;
+                }
+
+                break;
+        }
+    }
+
+    return false;
+}
+
+static bool mayTrapInSubtree(Ast* ast, NodeIndex node)
+{
+    return mayTrap(ast, getFirstNode(ast, node), node);
+}
+
+// Evaluating an operand has no side effect besides stopping the program on a
+// division by zero, so it can be dropped unless it may do that.
+static void replaceByInteger(Ast* ast, NodeIndex node, int value)
+{
+    bool unary = ast->types[node] == NODE_NEGATE;
+
+    if (mayTrapInSubtree(ast, ast->left[node]) || (!unary && mayTrapInSubtree(ast, ast->right[node]))) {
+        return;
+    }
+
+    removeSubtree(ast, ast->left[node]);
+
+    if (!unary) {
+        removeSubtree(ast, ast->right[node]);
+    }
+
+    ast->types[node] = NODE_INTEGER;
+    ast->values[node] = value;
+    ast->simplified[node] = true;
+}
+
+static void replaceByNegate(Ast* ast, NodeIndex node, NodeIndex inner, NodeIndex removed)
+{
+    ast->types[removed] = NODE_FOLDED;
+    ast->types[node] = NODE_NEGATE;
+    ast->left[node] = inner;
+    ast->right[node] = NODE_NONE;
+}
+
+static bool isInteger(Ast* ast, NodeIndex node, int value)
+{
+    return ast->types[node] == NODE_INTEGER && ast->values[node] == value;
+}
+
+// Constants are moved to the right of additions and multiplications, and
+// subtracting one adds its opposite, so that chains like (x + 1) - 2 are
+// merged into a single operation before the identities are applied.
+// Arithmetic wraps, which keeps every rewrite exact.
+static void simplifyBinary(Ast* ast, NodeIndex node)
+{
+    NodeType type = ast->types[node];
+    NodeIndex left = ast->left[node];
+    NodeIndex right = ast->right[node];
+
+    if ((type == NODE_ADD || type == NODE_MULTIPLY) && ast->types[left] == NODE_INTEGER) {
+        ast->left[node] = right;
+        ast->right[node] = left;
+        left = ast->left[node];
+        right = ast->right[node];
+    }
+
+    if (type == NODE_SUBSTRACT && ast->types[right] == NODE_INTEGER) {
+        type = ast->types[node] = NODE_ADD;
+        ast->values[right] = -(unsigned int) ast->values[right];
+    }
+
+    if (
+        (type == NODE_ADD || type == NODE_MULTIPLY) &&
+        ast->types[right] == NODE_INTEGER &&
+        ast->types[left] == type &&
+        ast->types[ast->right[left]] == NODE_INTEGER
+    ) {
+        unsigned int inner = ast->values[ast->right[left]];
+        unsigned int outer = ast->values[right];
+        ast->values[right] = type == NODE_ADD ? inner + outer : inner * outer;
+        ast->simplified[right] = ast->simplified[right] || ast->simplified[ast->right[left]];
+        ast->types[ast->right[left]] = NODE_FOLDED;
+        ast->types[left] = NODE_FOLDED;
+        left = ast->left[node] = ast->left[left];
+    }
+
+    switch (type) {
+        case NODE_ADD:
+            if (isInteger(ast, right, 0)) {
+                ast->types[right] = NODE_FOLDED;
+                replaceNode(ast, node, left);
+            }
+
             break;
-        case NODE_STATEMENTS: {
-            for (VECTOR_EACH(node->children.nodes)) {
-                Node* child = VECTOR_GET(node->children.nodes, i);
-                freeNode(child);
+        case NODE_SUBSTRACT:
+            if (isInteger(ast, left, 0)) {
+                replaceByNegate(ast, node, right, left);
+            } else if (ast->types[left] == NODE_LOAD && ast->types[right] == NODE_LOAD && ast->left[left] == ast->left[right]) {
+                replaceByInteger(ast, node, 0);
             }
 
-            freeVector(node->children.nodes);
             break;
-        }
-        case NODE_ASSIGNMENT: {
-            if (node->children.variableValue != NULL) {
-                freeNode(node->children.variableValue);
+        case NODE_MULTIPLY:
+        case NODE_DIVIDE:
+            if (isInteger(ast, right, 1)) {
+                ast->types[right] = NODE_FOLDED;
+                replaceNode(ast, node, left);
+            } else if (isInteger(ast, right, -1)) {
+                replaceByNegate(ast, node, left, right);
+            } else if (type == NODE_MULTIPLY && isInteger(ast, right, 0)) {
+                replaceByInteger(ast, node, 0);
+            }
+
+            break;
+        case NODE_MODULO:
+            if (isInteger(ast, right, 1) || isInteger(ast, right, -1)) {
+                replaceByInteger(ast, node, 0);
+            }
+
+            break;
+        case NODE_POWER:
+            if (isInteger(ast, right, 1)) {
+                ast->types[right] = NODE_FOLDED;
+                replaceNode(ast, node, left);
+            } else if (isInteger(ast, right, 0)) {
+                replaceByInteger(ast, node, 1);
             }
 
             break;
+    }
+}
+
+static void simplifyNegate(Ast* ast, NodeIndex node)
+{
+    NodeIndex inner = ast->left[node];
+
+    if (ast->types[inner] == NODE_NEGATE) {
+        ast->types[inner] = NODE_FOLDED;
+        replaceNode(ast, node, ast->left[inner]);
+    }
+}
+
+// Loads of a constant whose initializer was folded become a copy of the
+// literal. Their left still points to the declaration.
+static void propagateLoad(Ast* ast, NodeIndex node)
+{
+    NodeIndex value = ast->left[ast->left[node]];
+
+    if (value == NODE_NONE || (ast->types[value] != NODE_INTEGER && ast->types[value] != NODE_BOOLEAN)) {
+        return;
+    }
+
+    ast->types[node] = ast->types[value];
+    ast->values[node] = ast->values[value];
+    ast->simplified[node] = ast->simplified[value];
+}
+
+// Children precede their parent and declarations precede their loads, so a
+// single forward pass propagates constants, folds every constant subtree
+// bottom-up and, from -O1, simplifies what remains. The nodes of a statement are
+// contiguous, so [start, end) may also cover only some statements, as long as
+// the declarations they load were optimized before.
+void optimizeNodes(CompilerContext* context, Ast* ast, NodeIndex start, NodeIndex end)
+{
+    for (NodeIndex node = start; node < end; node++) {
+        switch (ast->types[node]) {
+            case NODE_LOAD:
+                propagateLoad(ast, node);
+                break;
+            case NODE_NEGATE:
+                foldNegate(ast, node);
+                break;
+            case NODE_ADD:
+            case NODE_SUBSTRACT:
+            case NODE_MULTIPLY:
+            case NODE_DIVIDE:
+            case NODE_MODULO:
+            case NODE_POWER:
+                foldBinary(context, ast, node);
+                break;
+        }
+
+        if (context->optimizationLevel < 1) {
+            continue;
+        }
+
+        switch (ast->types[node]) {
+            case NODE_NEGATE:
+                simplifyNegate(ast, node);
+                break;
+            case NODE_ADD:
+            case NODE_SUBSTRACT:
+            case NODE_MULTIPLY:
+            case NODE_DIVIDE:
+            case NODE_MODULO:
+            case NODE_POWER:
+                simplifyBinary(ast, node);
+
+                if (ast->types[node] == NODE_NEGATE) {
+                    simplifyNegate(ast, node);
+                }
+
+                break;
         }
     }
-    
-    free(node);
 }
 
-void optimizeNode(Module* module, Node* node)
+// Only the value of the last statement is used and evaluating a statement
+// has no side effect besides stopping the program on a division by zero, so
+// the other ones are kept only when they may do that or declare a constant
+// that a kept statement still loads. Walking the statements backward finds
+// them in one pass, as loads only read earlier statements.
+void removeDeadStatements(CompilerContext* context, Ast* ast)
 {
-    switch (node->type) {
-        case NODE_STATEMENTS: {
-            for (VECTOR_EACH(node->children.nodes)) {
-                Node* child = VECTOR_GET(node->children.nodes, i);
-                optimizeNode(module, child);
+    if (ast->root == NODE_NONE) {
+        return;
+    }
+
+    NodeIndex* statements = ast->lists + ast->left[ast->root];
+    uint32_t count = ast->right[ast->root];
+    bool* loaded = safeMalloc(sizeof(bool) * ast->size);
+    memset(loaded, 0, sizeof(bool) * ast->size);
+
+    for (uint32_t i = count; i-- > 0;) {
+        NodeIndex node = statements[i];
+        NodeIndex start = i > 0 ? statements[i - 1] + 1 : 0;
+        bool last = i == count - 1;
+
+        if (!last && !(ast->types[node] == NODE_ASSIGNMENT && loaded[node])) {
+            Span span = ast->spans[node];
+
+            if (mayTrap(ast, start, node)) {
+                addRemarkAt(context, REMARK_MISSED, "dead-statements", span.startIndex, span.endIndex,
+                    "Kept a statement whose value is never used: it may divide by zero.");
+            } else {
+                addRemarkAt(context, REMARK_PASSED, "dead-statements", span.startIndex, span.endIndex,
+                    "Removed a statement whose value is never used.");
+
+                for (NodeIndex child = start; child <= node; child++) {
+                    ast->types[child] = NODE_FOLDED;
+                }
+
+                continue;
             }
-            
-            return;
         }
-        case NODE_NEGATE: {
-            Node* inner = node->children.node;
-            optimizeNode(module, inner);
 
-            if (inner->type != NODE_INTEGER) {
-                return;
+        for (NodeIndex child = start; child <= node; child++) {
+            if (ast->types[child] == NODE_LOAD) {
+                loaded[ast->left[child]] = true;
             }
+        }
 
-            node->children.integer = -inner->children.integer;
-            node->type = NODE_INTEGER;
-
-            return;
+        // The last statement's value is its initializer, which doesn't have
+        // to be stored when nothing loads it.
+        if (last && ast->types[node] == NODE_ASSIGNMENT && ast->left[node] != NODE_NONE) {
+            statements[i] = ast->left[node];
+            ast->types[node] = NODE_FOLDED;
         }
+    }
+
+    free(loaded);
+}
+
+static bool isOperation(NodeType type)
+{
+    switch (type) {
         case NODE_ADD:
         case NODE_SUBSTRACT:
         case NODE_MULTIPLY:
         case NODE_DIVIDE:
         case NODE_MODULO:
-        case NODE_POWER: {
-            Node* left = node->children.left;
-            Node* right = node->children.right;
+        case NODE_POWER:
+        case NODE_NEGATE:
+            return true;
+        default:
+            return false;
+    }
+}
 
-            optimizeNode(module, left);
-            optimizeNode(module, right);
+// Compares the tree with its node types before folding. An operation folded
+// into its parent is gone, so only the outermost folded ones are reported.
+// An operation that is left is reported for each load it reads directly, as
+// loads are where the values that aren't constant come from.
+static void reportFolds(CompilerContext* context, Ast* ast, uint8_t* types)
+{
+    for (NodeIndex node = 0; node < ast->size; node++) {
+        Span span = ast->spans[node];
 
-            if (left->type != NODE_INTEGER || right->type != NODE_INTEGER) {
-                return;
-            }
+        if (!isOperation(types[node])) {
+            continue;
+        }
 
-            int value;
-
-            #define COMBINE(operator) left->children.integer operator right->children.integer
-            switch (node->type) {
-                case NODE_ADD:
-                    value = COMBINE(+);
-                    break;
-                case NODE_SUBSTRACT:
-                    value = COMBINE(-);
-                    break;
-                case NODE_MULTIPLY:
-                    value = COMBINE(*);
-                    break;
-                case NODE_DIVIDE:
-                    if (right->children.integer == 0) {
-                        addErrorAt(module, right->startIndex, right->endIndex, "Can't divide per zero.");
-
-                        return;
-                    }
-
-                    value = COMBINE(/);
-                    break;
-                case NODE_MODULO:
-                    if (right->children.integer == 0) {
-                        addErrorAt(module, right->startIndex, right->endIndex, "Can't modulo per zero.");
-
-                        return;
-                    }
-
-                    value = COMBINE(%);
-                    break;
-                case NODE_POWER:
-                    value = pow(left->children.integer, right->children.integer);
-                    break;
-            }
-            #undef COMBINE
+        if (ast->types[node] == NODE_INTEGER) {
+            addRemarkAt(context, REMARK_PASSED, "fold", span.startIndex, span.endIndex, "Folded to %d.", ast->values[node]);
 
-            freeNode(node->children.left);
-            freeNode(node->children.right);
-            node->type = NODE_INTEGER;
-            node->children.integer = value;
+            continue;
+        }
 
-            return;
+        if (!isOperation(ast->types[node])) {
+            continue;
         }
-        case NODE_ASSIGNMENT: {
-            Node* value = node->children.variableValue;
 
-            if (value != NULL) {
-                optimizeNode(module, value);
-            }
+        NodeIndex operands[] = {ast->left[node], ast->types[node] == NODE_NEGATE ? NODE_NONE : ast->right[node]};
 
-            return;
+        for (int i = 0; i < 2; i++) {
+            if (operands[i] != NODE_NONE && ast->types[operands[i]] == NODE_LOAD) {
+                addRemarkAt(context, REMARK_MISSED, "fold", span.startIndex, span.endIndex,
+                    "Not folded: \"%s\" has no constant value.", getIdentifierName(context->identifiers, ast->values[operands[i]]));
+            }
         }
     }
 }
+
+void foldAst(CompilerContext* context, Ast* ast)
+{
+    if (!wantsRemarks(context, REMARK_PASSED | REMARK_MISSED)) {
+        optimizeNodes(context, ast, 0, ast->size);
+
+        return;
+    }
+
+    uint8_t* types = safeMalloc(ast->size);
+    memcpy(types, ast->types, ast->size);
+    optimizeNodes(context, ast, 0, ast->size);
+    reportFolds(context, ast, types);
+    free(types);
+}
+
+void optimizeAst(CompilerContext* context, Ast* ast)
+{
+    foldAst(context, ast);
+
+    if (!hasErrors(context)) {
+        removeDeadStatements(context, ast);
+    }
+}
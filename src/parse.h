@@ -4,57 +4,18 @@
 #include "module.h"
 #include "vector.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include "symbol.h"
-
-typedef enum {
-    // STRUCTS
-    NODE_STATEMENTS,
-    NODE_ASSIGNMENT,
-    NODE_LOAD,
-
-    // INSTRUCTIONS
-    NODE_ADD,
-    NODE_SUBSTRACT,
-    NODE_MULTIPLY,
-    NODE_DIVIDE,
-    NODE_MODULO,
-    NODE_NEGATE,
-    NODE_POWER,
-
-    // VALUES
-    NODE_INTEGER,
-    NODE_BOOLEAN,
-    NODE_NULL,
-} NodeType;
-
-typedef struct Node {
-    NodeType type;
-
-    union {
-        int integer;
-        struct Node* node;
-        bool boolean;
-        Vector* nodes;
-        Variable* variable;
-
-        struct {
-            struct Node* left;
-            struct Node* right;
-        };
-
-        struct {
-            Variable* variableAssignment;
-            struct Node* variableValue;
-        };
-    } children;
-
-    int startIndex;
-    int endIndex;
-    char* valueType;
-} Node;
-
-Node* parse(Module* module, Vector* tokens);
-void freeNode(Node* node);
-void optimizeNode(Module* module, Node* node);
+#include "scan.h"
+#include "arena.h"
+#include "ast.h"
+#include "context.h"
+
+Ast* parse(CompilerContext* context, TokenBuffer* tokens);
+NodeIndex parseStatement(CompilerContext* context, TokenBuffer* tokens, Ast* ast, Environment* environment, size_t* index);
+void foldAst(CompilerContext* context, Ast* ast);
+void removeDeadStatements(CompilerContext* context, Ast* ast);
+void optimizeAst(CompilerContext* context, Ast* ast);
+void optimizeNodes(CompilerContext* context, Ast* ast, NodeIndex start, NodeIndex end);
 
 #endif
@@ -0,0 +1,148 @@
+#include "pass.h"
+#include "error.h"
+#include "util.h"
+#include <stdlib.h>
+#include <time.h>
+
+PassManager* newPassManager(CompilerContext* context, bool timing)
+{
+    PassManager* manager = safeMalloc(sizeof(PassManager));
+    manager->context = context;
+    manager->astPasses = newVector();
+    manager->irPasses = newVector();
+    manager->timing = timing;
+    manager->timings = newVector();
+
+    return manager;
+}
+
+static void addPass(Vector* passes, char* name, int level, AstPass runAst, IRPass runIR)
+{
+    Pass* pass = safeMalloc(sizeof(Pass));
+    pass->name = name;
+    pass->level = level;
+    pass->runAst = runAst;
+    pass->runIR = runIR;
+    pushVector(passes, pass);
+}
+
+void addAstPass(PassManager* manager, char* name, int level, AstPass run)
+{
+    addPass(manager->astPasses, name, level, run, NULL);
+}
+
+void addIRPass(PassManager* manager, char* name, int level, IRPass run)
+{
+    addPass(manager->irPasses, name, level, NULL, run);
+}
+
+static double now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// Everything between startPass and finishPass is recorded under the name
+// given, so the stages that aren't passes can be timed as well.
+void startPass(PassManager* manager)
+{
+    if (!manager->timing) {
+        return;
+    }
+
+    getAllocationCounts(&manager->startAllocations, &manager->startBytes);
+    manager->start = now();
+}
+
+void finishPass(PassManager* manager, char* name)
+{
+    if (!manager->timing) {
+        return;
+    }
+
+    double end = now();
+    PassTiming* timing = safeMalloc(sizeof(PassTiming));
+    getAllocationCounts(&timing->allocations, &timing->bytes);
+    timing->name = name;
+    timing->seconds = end - manager->start;
+    timing->allocations -= manager->startAllocations;
+    timing->bytes -= manager->startBytes;
+    pushVector(manager->timings, timing);
+}
+
+// Stops at the first pass reporting an error: the next ones expect a valid
+// tree.
+void runAstPasses(PassManager* manager, Ast* ast)
+{
+    for (VECTOR_EACH(manager->astPasses)) {
+        Pass* pass = VECTOR_GET(manager->astPasses, i);
+
+        if (hasErrors(manager->context)) {
+            break;
+        }
+
+        if (pass->level > manager->context->optimizationLevel) {
+            continue;
+        }
+
+        startPass(manager);
+        pass->runAst(manager->context, ast);
+        finishPass(manager, pass->name);
+    }
+}
+
+void runIRPasses(PassManager* manager, IR* ir)
+{
+    for (VECTOR_EACH(manager->irPasses)) {
+        Pass* pass = VECTOR_GET(manager->irPasses, i);
+
+        if (pass->level > manager->context->optimizationLevel) {
+            continue;
+        }
+
+        startPass(manager);
+        pass->runIR(manager->context, ir);
+        finishPass(manager, pass->name);
+    }
+}
+
+void writeTimeReport(PassManager* manager, FILE* output)
+{
+    double total = 0;
+    size_t allocations = 0;
+    size_t bytes = 0;
+
+    for (VECTOR_EACH(manager->timings)) {
+        PassTiming* timing = VECTOR_GET(manager->timings, i);
+        total += timing->seconds;
+        allocations += timing->allocations;
+        bytes += timing->bytes;
+    }
+
+    fprintf(output, "%-20s %12s %8s %12s %14s\n", "Pass", "Time (ms)", "Time", "Allocations", "Bytes");
+
+    for (VECTOR_EACH(manager->timings)) {
+        PassTiming* timing = VECTOR_GET(manager->timings, i);
+        fprintf(output, "%-20s %12.3f %7.1f%% %12zu %14zu\n",
+            timing->name, timing->seconds * 1e3, total > 0 ? timing->seconds / total * 100 : 0, timing->allocations, timing->bytes);
+    }
+
+    fprintf(output, "%-20s %12.3f %7.1f%% %12zu %14zu\n", "Total", total * 1e3, 100.0, allocations, bytes);
+}
+
+void freePassManager(PassManager* manager)
+{
+    Vector* vectors[] = {manager->astPasses, manager->irPasses, manager->timings};
+
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < VECTOR_SIZE(vectors[i]); j++) {
+            free(VECTOR_GET(vectors[i], j));
+        }
+
+        freeVector(vectors[i]);
+    }
+
+    free(manager);
+}
@@ -0,0 +1,50 @@
+#ifndef OPAL_PASS_H
+#define OPAL_PASS_H
+
+#include "context.h"
+#include "ast.h"
+#include "ir.h"
+#include "vector.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef void (*AstPass)(CompilerContext* context, Ast* ast);
+typedef void (*IRPass)(CompilerContext* context, IR* ir);
+
+// A pass runs when the optimization level is at least its own.
+typedef struct {
+    char* name;
+    int level;
+    AstPass runAst;
+    IRPass runIR;
+} Pass;
+
+typedef struct {
+    char* name;
+    double seconds;
+    size_t allocations;
+    size_t bytes;
+} PassTiming;
+
+typedef struct {
+    CompilerContext* context;
+    Vector* astPasses;
+    Vector* irPasses;
+    bool timing;
+    Vector* timings;
+    double start;
+    size_t startAllocations;
+    size_t startBytes;
+} PassManager;
+
+PassManager* newPassManager(CompilerContext* context, bool timing);
+void addAstPass(PassManager* manager, char* name, int level, AstPass run);
+void addIRPass(PassManager* manager, char* name, int level, IRPass run);
+void startPass(PassManager* manager);
+void finishPass(PassManager* manager, char* name);
+void runAstPasses(PassManager* manager, Ast* ast);
+void runIRPasses(PassManager* manager, IR* ir);
+void writeTimeReport(PassManager* manager, FILE* output);
+void freePassManager(PassManager* manager);
+
+#endif
@@ -0,0 +1,109 @@
+#include "remark.h"
+#include "error.h"
+#include "util.h"
+#include <stdarg.h>
+#include <stdlib.h>
+
+bool wantsRemarks(CompilerContext* context, RemarkKind kind)
+{
+    return context->remarkKinds & kind;
+}
+
+// Remarks of a kind nobody asked for are dropped before being formatted,
+// so passes can report freely.
+void addRemarkAt(CompilerContext* context, RemarkKind kind, char* pass, size_t startIndex, size_t endIndex, char* message, ...)
+{
+    if (!wantsRemarks(context, kind)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, message);
+    Remark* remark = safeMalloc(sizeof(Remark));
+    remark->kind = kind;
+    remark->pass = pass;
+    remark->message = formatArguments(message, args);
+    remark->located = endIndex > startIndex;
+    remark->startIndex = startIndex;
+    remark->endIndex = endIndex;
+    pushVector(context->remarks, remark);
+    va_end(args);
+}
+
+// Remarks are rendered like errors, quoting the code they are about.
+void writeRemarks(CompilerContext* context, FILE* output, int kinds)
+{
+    for (VECTOR_EACH(context->remarks)) {
+        Remark* remark = VECTOR_GET(context->remarks, i);
+
+        if (!(remark->kind & kinds)) {
+            continue;
+        }
+
+        char* message = format("%s: %s", remark->pass, remark->message);
+        Error error = {message, remark->located, remark->startIndex, remark->endIndex};
+        char* text = renderError(context, &error);
+        fprintf(output, "[%s] %s\n", remark->kind == REMARK_PASSED ? "PASSED" : "MISSED", text);
+        free(text);
+        free(message);
+    }
+}
+
+static void writeJsonString(FILE* output, char* string)
+{
+    fputc('"', output);
+
+    for (unsigned char* c = (unsigned char*) string; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(output, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(output, "\\u%04x", *c);
+        } else {
+            fputc(*c, output);
+        }
+    }
+
+    fputc('"', output);
+}
+
+static void writeJsonPosition(FILE* output, Module* module, size_t index)
+{
+    size_t line = getModuleLine(module, index);
+    fprintf(output, "{\"line\": %zu, \"column\": %zu}", line, index - getModuleLineStart(module, line) + 1);
+}
+
+// Writes every remark collected as a JSON array, one object per line so the
+// records of two builds can be diffed. Positions are 1-based and columns
+// count bytes; the end is exclusive.
+void writeRemarksJson(CompilerContext* context, FILE* output)
+{
+    Module* module = context->module;
+    fprintf(output, "[\n");
+
+    for (VECTOR_EACH(context->remarks)) {
+        Remark* remark = VECTOR_GET(context->remarks, i);
+        fprintf(output, "  {\"kind\": \"%s\", \"pass\": ", remark->kind == REMARK_PASSED ? "passed" : "missed");
+        writeJsonString(output, remark->pass);
+        fprintf(output, ", \"message\": ");
+        writeJsonString(output, remark->message);
+        fprintf(output, ", \"file\": ");
+        writeJsonString(output, module->filename);
+
+        if (remark->located) {
+            fprintf(output, ", \"start\": ");
+            writeJsonPosition(output, module, remark->startIndex);
+            fprintf(output, ", \"end\": ");
+            writeJsonPosition(output, module, remark->endIndex);
+        }
+
+        fprintf(output, "}%s\n", i < VECTOR_SIZE(context->remarks) - 1 ? "," : "");
+    }
+
+    fprintf(output, "]\n");
+}
+
+void freeRemark(Remark* remark)
+{
+    free(remark->message);
+    free(remark);
+}
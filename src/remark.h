@@ -0,0 +1,29 @@
+#ifndef OPAL_REMARK_H
+#define OPAL_REMARK_H
+
+#include "context.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+// Kinds are flags, so a context can collect several of them.
+typedef enum {
+    REMARK_PASSED = 1,
+    REMARK_MISSED = 2,
+} RemarkKind;
+
+typedef struct {
+    RemarkKind kind;
+    char* pass;
+    char* message;
+    bool located;
+    size_t startIndex;
+    size_t endIndex;
+} Remark;
+
+bool wantsRemarks(CompilerContext* context, RemarkKind kind);
+void addRemarkAt(CompilerContext* context, RemarkKind kind, char* pass, size_t startIndex, size_t endIndex, char* message, ...);
+void writeRemarks(CompilerContext* context, FILE* output, int kinds);
+void writeRemarksJson(CompilerContext* context, FILE* output);
+void freeRemark(Remark* remark);
+
+#endif
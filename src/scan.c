@@ -1,428 +1,1077 @@
 #include "scan.h"
-#include "scan.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include "util.h"
 #include <string.h>
-#include "stringbuilder.h"
 #include "error.h"
+#include "simd.h"
+#include "intern.h"
+#include "vector.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define TOKEN_BUFFER_INITIAL_CAPACITY 64
+
+#ifndef SCAN_CHUNK_MIN_SIZE
+#define SCAN_CHUNK_MIN_SIZE (1 << 20)
+#endif
+
+#define SCAN_MAX_CHUNKS 64
+
+// No lexeme reads more than two bytes past the end of the last token it
+// started before.
+#define SCAN_LOOKAHEAD 2
+
+#ifdef __GNUC__
+#define SCAN_COMPUTED_GOTO
+#endif
+
+// CHAR_ALPHA and CHAR_DIGIT come first so that identifier characters can be
+// matched with a single comparison. Sources are valid UTF-8 once loaded, so
+// every byte with the high bit set belongs to a non-ASCII character and is
+// accepted in identifiers.
+typedef enum {
+    CHAR_ALPHA,
+    CHAR_DIGIT,
+    CHAR_END,
+    CHAR_PUNCTUATION,
+    CHAR_OPERATOR,
+    CHAR_SLASH,
+    CHAR_AMPERSAND,
+    CHAR_PIPE,
+    CHAR_QUOTE,
+    CHAR_DOUBLE_QUOTE,
+    CHAR_WHITESPACE,
+    CHAR_INVALID
+} CharClass;
+
+#define AL CHAR_ALPHA
+#define DI CHAR_DIGIT
+#define EN CHAR_END
+#define PU CHAR_PUNCTUATION
+#define OP CHAR_OPERATOR
+#define SL CHAR_SLASH
+#define AM CHAR_AMPERSAND
+#define PI CHAR_PIPE
+#define QU CHAR_QUOTE
+#define DQ CHAR_DOUBLE_QUOTE
+#define WS CHAR_WHITESPACE
+#define __ CHAR_INVALID
+
+static const unsigned char charClasses[256] = {
+    EN, __, __, __, __, __, __, __, __, WS, WS, __, __, WS, __, __,
+    __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+    WS, OP, DQ, PU, __, OP, AM, QU, PU, PU, OP, OP, PU, OP, PU, SL,
+    DI, DI, DI, DI, DI, DI, DI, DI, DI, DI, PU, PU, OP, OP, OP, PU,
+    __, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, PU, __, PU, PU, AL,
+    __, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, PU, PI, PU, __, __,
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL
+};
+
+#undef AL
+#undef DI
+#undef EN
+#undef PU
+#undef OP
+#undef SL
+#undef AM
+#undef PI
+#undef QU
+#undef DQ
+#undef WS
+#undef __
+
+static const TokenType punctuationTokens[256] = {
+    ['('] = TOKEN_LEFT_PAREN,
+    [')'] = TOKEN_RIGHT_PAREN,
+    ['{'] = TOKEN_LEFT_BRACE,
+    ['}'] = TOKEN_RIGHT_BRACE,
+    ['['] = TOKEN_LEFT_BRACKET,
+    [']'] = TOKEN_RIGHT_BRACKET,
+    [';'] = TOKEN_SEMILICON,
+    ['.'] = TOKEN_DOT,
+    [','] = TOKEN_COMMA,
+    ['^'] = TOKEN_CIRCUMFLEX,
+    ['?'] = TOKEN_QUESTION_MARK,
+    ['#'] = TOKEN_HASHTAG,
+    [':'] = TOKEN_COLON,
+    ['+'] = TOKEN_PLUS,
+    ['-'] = TOKEN_MINUS,
+    ['*'] = TOKEN_STAR,
+    ['%'] = TOKEN_MODULO,
+    ['='] = TOKEN_EQUAL,
+    ['!'] = TOKEN_BANG,
+    ['<'] = TOKEN_LESS,
+    ['>'] = TOKEN_GREATER
+};
+
+static const TokenType equalTokens[256] = {
+    ['+'] = TOKEN_PLUS_EQUAL,
+    ['-'] = TOKEN_MINUS_EQUAL,
+    ['*'] = TOKEN_STAR_EQUAL,
+    ['%'] = TOKEN_MODULO_EQUAL,
+    ['='] = TOKEN_DOUBLE_EQUAL,
+    ['!'] = TOKEN_BANG_EQUAL,
+    ['<'] = TOKEN_LESS_EQUAL,
+    ['>'] = TOKEN_GREATER_EQUAL
+};
 
 typedef struct {
+    CompilerContext* context;
     Module* module;
-    int startIndex;
-    int currentIndex;
-    Vector* tokens;
+    size_t startIndex;
+    size_t currentIndex;
+    size_t endIndex;
+    bool interning;
+    TokenBuffer* tokens;
+    Vector* errors;
 } Scanner;
 
-Scanner* scanner;
-
-static Token* makeToken(TokenType type)
+static Token makeToken(Scanner* scanner, TokenType type)
 {
-    Token* token = safeMalloc(sizeof(Token));
-    token->type = type;
-    token->module = scanner->module;
-    token->startIndex = scanner->startIndex;
-    token->endIndex = scanner->currentIndex + 1;
-    
+    Token token;
+    token.type = type;
+    token.startIndex = scanner->startIndex;
+    token.length = scanner->currentIndex + 1 - scanner->startIndex;
+
     return token;
 }
 
-static Scanner* newScanner(Module* module)
+static TokenBuffer* newTokenBuffer(Module* module)
+{
+    TokenBuffer* buffer = safeMalloc(sizeof(TokenBuffer));
+    buffer->module = module;
+    buffer->tokens = safeMalloc(sizeof(Token) * TOKEN_BUFFER_INITIAL_CAPACITY);
+    buffer->size = 0;
+    buffer->capacity = TOKEN_BUFFER_INITIAL_CAPACITY;
+    buffer->tailSize = 0;
+
+    return buffer;
+}
+
+static void pushTokenBuffer(TokenBuffer* buffer, Token token)
+{
+    if (buffer->size == buffer->capacity) {
+        buffer->capacity *= 2;
+        buffer->tokens = safeRealloc(buffer->tokens, sizeof(Token) * buffer->capacity);
+    }
+
+    buffer->tokens[buffer->size++] = token;
+}
+
+void freeTokenBuffer(TokenBuffer* buffer)
+{
+    free(buffer->tokens);
+    free(buffer);
+}
+
+static Scanner* newScanner(CompilerContext* context, size_t startIndex, size_t endIndex)
 {
     Scanner* scanner = safeMalloc(sizeof(Scanner));
-    scanner->module = module;
-    scanner->startIndex = 0;
-    scanner->currentIndex = 0;
-    scanner->tokens = newVector();
+    scanner->context = context;
+    scanner->module = context->module;
+    scanner->startIndex = startIndex;
+    scanner->currentIndex = startIndex;
+    scanner->endIndex = endIndex;
+    scanner->interning = true;
+    scanner->tokens = newTokenBuffer(context->module);
+    scanner->errors = newVector();
 
     return scanner;
 }
 
-static char peekAt(int index)
+static void freeScanner(Scanner* scanner)
+{
+    freeVector(scanner->errors);
+    free(scanner);
+}
+
+static void addScanError(Scanner* scanner, size_t startIndex, size_t endIndex, char* message, ...)
+{
+    va_list args;
+    va_start(args, message);
+    char* formattedMessage = formatArguments(message, args);
+    va_end(args);
+
+    ScanError* error = safeMalloc(sizeof(ScanError));
+    error->tokenIndex = scanner->startIndex;
+    error->startIndex = startIndex;
+    error->endIndex = endIndex;
+    error->message = formattedMessage;
+    pushVector(scanner->errors, error);
+}
+
+void freeScanError(ScanError* error)
+{
+    free(error->message);
+    free(error);
+}
+
+static char peekAt(Scanner* scanner, size_t index)
 {
     return scanner->module->source[index];
 }
 
-static char peek()
+static char peek(Scanner* scanner)
 {
-    return peekAt(scanner->currentIndex);
+    return peekAt(scanner, scanner->currentIndex);
 }
 
-static void advance()
+static void advance(Scanner* scanner)
 {
     scanner->currentIndex++;
 }
 
-static bool isAtEnd()
+static char* current(Scanner* scanner)
 {
-    return peek(scanner) == '\0';
+    return scanner->module->source + scanner->currentIndex;
 }
 
-static bool isDigit(char c)
+static void advanceTo(Scanner* scanner, char* position)
 {
-    return c >= '0' && c <= '9';
+    scanner->currentIndex = position - scanner->module->source;
+}
+
+static bool isAtEnd(Scanner* scanner)
+{
+    return peek(scanner) == '\0';
 }
 
-static int convertCharToInteger(char c)
+static bool isDigit(char c)
 {
-    return (int) c - 48;
+    return c >= '0' && c <= '9';
 }
 
-static void back()
+static void back(Scanner* scanner)
 {
     scanner->currentIndex--;
 }
 
-static char peekNext()
+static char peekNext(Scanner* scanner)
 {
-    return peekAt(scanner->currentIndex + 1);
+    return peekAt(scanner, scanner->currentIndex + 1);
 }
 
-static bool match(char c)
+static bool match(Scanner* scanner, char c)
 {
-    if (isAtEnd() || peekNext() != c) {
+    if (isAtEnd(scanner) || peekNext(scanner) != c) {
         return false;
     }
 
-    advance();
+    advance(scanner);
 
     return true;
 }
 
-static Token* makeNumber()
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SCAN_SWAR_DIGITS
+#endif
+
+#define MAX_EXACT_MANTISSA (1ULL << 53)
+#define MAX_EXACT_POWER_OF_TEN 22
+
+static const double powersOfTen[MAX_EXACT_POWER_OF_TEN + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#ifdef SCAN_SWAR_DIGITS
+static bool isEightDigits(uint64_t chunk)
+{
+    return !(
+        ((chunk & 0xF0F0F0F0F0F0F0F0) |
+        (((chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ^
+        0x3333333333333333
+    );
+}
+
+static uint64_t parseEightDigits(uint64_t chunk)
 {
-    char c = peek();
-    float value = convertCharToInteger(c);
-    advance();
-    bool hasDot = false;
-    int divider = 10;
+    chunk -= 0x3030303030303030;
+    chunk = chunk * 10 + (chunk >> 8);
+    chunk = (
+        (chunk & 0x000000FF000000FF) * (100 + (1000000ULL << 32)) +
+        ((chunk >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32))
+    ) >> 32;
+
+    return chunk;
+}
+#endif
+
+// Accumulates the digits starting at position into value and returns the
+// first non-digit. overflow is set once value no longer fits in 64 bits.
+static char* scanDigits(char* position, char* end, uint64_t* value, bool* overflow)
+{
+#ifdef SCAN_SWAR_DIGITS
+    while (end - position >= 8) {
+        uint64_t chunk;
+        memcpy(&chunk, position, 8);
 
-    while (isDigit(c = peek())) {
-        value = hasDot ?
-            value + convertCharToInteger(c) / divider :
-            value * 10 + convertCharToInteger(c);
-        
-        if (hasDot) {
-            divider *= 10;
+        if (!isEightDigits(chunk)) {
+            break;
         }
 
-        if (!hasDot && match('.')) {
-            hasDot = true;
+        uint64_t digits = parseEightDigits(chunk);
+
+        if (*value > (UINT64_MAX - digits) / 100000000) {
+            *overflow = true;
         }
 
-        advance();
+        *value = *value * 100000000 + digits;
+        position += 8;
     }
+#endif
 
-    back();
-    Token* token = makeToken(hasDot ? TOKEN_FLOAT : TOKEN_INTEGER);
-    
-    if (hasDot) {
-        token->value._float = value;
-    } else {
-        token->value.integer = (int)value;
+    while (isDigit(*position)) {
+        uint64_t digit = *position - '0';
+
+        if (*value > (UINT64_MAX - digit) / 10) {
+            *overflow = true;
+        }
+
+        *value = *value * 10 + digit;
+        position++;
     }
 
-    return token;
+    return position;
 }
 
-static void skipWhitespaces()
+// Clinger's fast path: when the mantissa and the power of ten are both
+// exactly representable, a single division is correctly rounded. Anything
+// else goes through strtod on a copy of the literal.
+static double convertDecimal(char* start, char* end, uint64_t mantissa, size_t fractionDigits, bool overflow)
 {
-    while(true) {
-        if (isWhitespace(peek())) {
-            advance();
+    if (!overflow && mantissa <= MAX_EXACT_MANTISSA && fractionDigits <= MAX_EXACT_POWER_OF_TEN) {
+        return (double) mantissa / powersOfTen[fractionDigits];
+    }
 
-            continue;
+    size_t length = end - start;
+    char buffer[64];
+    char* literal = length < sizeof(buffer) ? buffer : safeMalloc(length + 1);
+    memcpy(literal, start, length);
+    literal[length] = '\0';
+    double value = strtod(literal, NULL);
+
+    if (literal != buffer) {
+        free(literal);
+    }
+
+    return value;
+}
+
+static Token makeNumber(Scanner* scanner)
+{
+    char* start = current(scanner);
+    char* end = scanner->module->source + scanner->module->length;
+    uint64_t mantissa = 0;
+    bool overflow = false;
+    char* position = scanDigits(start, end, &mantissa, &overflow);
+
+    if (*position != '.' || !isDigit(position[1])) {
+        advanceTo(scanner, position - 1);
+        Token token = makeToken(scanner, TOKEN_INTEGER);
+
+        if (overflow || mantissa > INT64_MAX) {
+            addScanError(scanner, token.startIndex, TOKEN_END_INDEX(&token), "Integer literal is too large.");
         }
 
-        return;
+        token.value.integer = mantissa;
+
+        return token;
     }
+
+    char* fraction = position + 1;
+    position = scanDigits(fraction, end, &mantissa, &overflow);
+    advanceTo(scanner, position - 1);
+    Token token = makeToken(scanner, TOKEN_FLOAT);
+    token.value._float = convertDecimal(start, position, mantissa, position - fraction, overflow);
+
+    return token;
 }
 
-static bool isAlpha(char c)
+// Most tokens are separated by at most one whitespace character, which is
+// cheaper to test through the table than to hand to the SIMD kernel.
+static char* skipWhitespacesFrom(char* position)
 {
-    return (c >= 'a' && c <= 'z') ||
-        (c >= 'A' && c <= 'Z') ||
-        c == '_';
+    if (charClasses[(unsigned char) *position] != CHAR_WHITESPACE) {
+        return position;
+    }
+
+    position++;
+
+    if (charClasses[(unsigned char) *position] != CHAR_WHITESPACE) {
+        return position;
+    }
+
+    return skipWhitespaceRun(position);
 }
 
-static Token* makeKeyword(char* keyword)
+static void skipWhitespaces(Scanner* scanner)
 {
-    switch (*keyword) {
-        case 'a':
-            if (!strcmp(keyword, "abstract")) {
-                return makeToken(TOKEN_ABSTRACT);
-            }
-            break;
-        case 'b':
-            if (!strcmp(keyword, "break")) {
-                return makeToken(TOKEN_BREAK);
-            }
-            break;
-        case 'c':
-            if (!strcmp(keyword, "class")) {
-                return makeToken(TOKEN_CLASS);
-            }
-            if (!strcmp(keyword, "const")) {
-                return makeToken(TOKEN_CONST);
-            }
-            if (!strcmp(keyword, "continue")) {
-                return makeToken(TOKEN_CONTINUE);
-            }
-            break;
-        case 'd':
-            if (!strcmp(keyword, "do")) {
-                return makeToken(TOKEN_DO);
-            }
-            break;
-        case 'e':
-            if (!strcmp(keyword, "else")) {
-                return makeToken(TOKEN_ELSE);
-            }
-            if (!strcmp(keyword, "enum")) {
-                return makeToken(TOKEN_ENUM);
-            }
-            break;
-        case 'f':
-            if (!strcmp(keyword, "false")) {
-                return makeToken(TOKEN_FALSE);
-            }
-            if (!strcmp(keyword, "for")) {
-                return makeToken(TOKEN_FOR);
-            }
-            break;
-        case 'i':
-            if (!strcmp(keyword, "if")) {
-                return makeToken(TOKEN_IF);
-            }
-            if (!strcmp(keyword, "interface")) {
-                return makeToken(TOKEN_INTERFACE);
+    advanceTo(scanner, skipWhitespacesFrom(current(scanner)));
+}
+
+static TokenType checkKeyword(char* start, char* rest, size_t length, TokenType type)
+{
+    return memcmp(start + 1, rest, length - 1) ? TOKEN_IDENTIFIER : type;
+}
+
+static TokenType makeKeyword(char* start, size_t length)
+{
+    #define KEYWORD(rest, type) checkKeyword(start, rest, length, type)
+    switch (length) {
+        case 2:
+            switch (*start) {
+                case 'd': return KEYWORD("o", TOKEN_DO);
+                case 'i': return KEYWORD("f", TOKEN_IF);
             }
             break;
-        case 'l':
-            if (!strcmp(keyword, "loop")) {
-                return makeToken(TOKEN_LOOP);
+        case 3:
+            switch (*start) {
+                case 'f': return KEYWORD("or", TOKEN_FOR);
+                case 'v': return KEYWORD("ar", TOKEN_VAR);
             }
             break;
-        case 'n':
-            if (!strcmp(keyword, "null")) {
-                return makeToken(TOKEN_NULL);
+        case 4:
+            switch (*start) {
+                case 'e':
+                    if (start[1] == 'l') {
+                        return KEYWORD("lse", TOKEN_ELSE);
+                    }
+
+                    return KEYWORD("num", TOKEN_ENUM);
+                case 'l': return KEYWORD("oop", TOKEN_LOOP);
+                case 'n': return KEYWORD("ull", TOKEN_NULL);
+                case 't': return KEYWORD("rue", TOKEN_TRUE);
             }
             break;
-        case 'r':
-            if (!strcmp(keyword, "return")) {
-                return makeToken(TOKEN_RETURN);
+        case 5:
+            switch (*start) {
+                case 'b': return KEYWORD("reak", TOKEN_BREAK);
+                case 'c':
+                    if (start[2] == 'a') {
+                        return KEYWORD("lass", TOKEN_CLASS);
+                    }
+
+                    return KEYWORD("onst", TOKEN_CONST);
+                case 'f': return KEYWORD("alse", TOKEN_FALSE);
+                case 'w': return KEYWORD("hile", TOKEN_WHILE);
             }
             break;
-        case 't':
-            if (!strcmp(keyword, "true")) {
-                return makeToken(TOKEN_TRUE);
+        case 6:
+            if (*start == 'r') {
+                return KEYWORD("eturn", TOKEN_RETURN);
             }
             break;
-        case 'v':
-            if (!strcmp(keyword, "var")) {
-                return makeToken(TOKEN_VAR);
+        case 8:
+            switch (*start) {
+                case 'a': return KEYWORD("bstract", TOKEN_ABSTRACT);
+                case 'c': return KEYWORD("ontinue", TOKEN_CONTINUE);
             }
             break;
-        case 'w':
-            if (!strcmp(keyword, "while")) {
-                return makeToken(TOKEN_WHILE);
+        case 9:
+            if (*start == 'i') {
+                return KEYWORD("nterface", TOKEN_INTERFACE);
             }
             break;
     }
+    #undef KEYWORD
 
-    return NULL;
+    return TOKEN_IDENTIFIER;
 }
 
-static Token* makeIdentifier()
+static bool expect(Scanner* scanner, char c, char* message)
 {
-    StringBuilder* builder = newStringBuilder();
+    if (!match(scanner, c)) {
+        addScanError(scanner, scanner->currentIndex + 1, scanner->currentIndex + 2, message, peekNext(scanner));
 
-    while (isAlpha(peek()) || isDigit(peek())) {
-        addStringBuilder(builder, peek());
-        advance();
+        return false;
     }
 
-    back();
+    return true;
+}
+
+static Token makeChar(Scanner* scanner)
+{
+    advance(scanner);
+    Token token = makeToken(scanner, TOKEN_CHAR);
+    token.value.c = peek(scanner);
+    expect(scanner, '\'', "A character value must be closed with \"'\" but received \"%c\".");
+
+    return token;
+}
+
+static Token makeString(Scanner* scanner)
+{
+    advance(scanner);
+    advanceTo(scanner, findCharacter(current(scanner), '"'));
 
-    char* identifier = buildStringBuilder(builder);
-    freeStringBuilder(builder);
-    Token* token = makeKeyword(identifier);
+    if (isAtEnd(scanner)) {
+        addScanError(scanner, scanner->currentIndex, scanner->currentIndex + 1, "A string value must be closed with '\"' but it's the end of the file.");
+        back(scanner);
+
+        return makeToken(scanner, TOKEN_NONE);
+    }
+
+    return makeToken(scanner, TOKEN_STRING);
+}
+
+static Token singleLineComment(Scanner* scanner)
+{
+    advance(scanner);
+    advanceTo(scanner, findCharacter(current(scanner), '\n'));
+
+    return makeToken(scanner, TOKEN_NONE);
+}
+
+static Token multipleLinesComment(Scanner* scanner)
+{
+    advance(scanner);
+    char* start = current(scanner);
+    char* end = findCharacter(start, '/');
+
+    while (*end != '\0' && (end == start || end[-1] != '*')) {
+        end = findCharacter(end + 1, '/');
+    }
+
+    advanceTo(scanner, end);
+
+    return makeToken(scanner, TOKEN_NONE);
+}
+
+static Token getToken(Scanner* scanner)
+{
+    char* source = scanner->module->source;
+    char* start = skipWhitespacesFrom(source + scanner->currentIndex);
+    char* end = start + 1;
+    unsigned char c = *start;
+    TokenType type;
+    scanner->startIndex = start - source;
+
+#ifdef SCAN_COMPUTED_GOTO
+    static void* const handlers[] = {
+        [CHAR_ALPHA] = &&alpha,
+        [CHAR_DIGIT] = &&digit,
+        [CHAR_END] = &&eof,
+        [CHAR_PUNCTUATION] = &&punctuation,
+        [CHAR_OPERATOR] = &&operator,
+        [CHAR_SLASH] = &&slash,
+        [CHAR_AMPERSAND] = &&ampersand,
+        [CHAR_PIPE] = &&pipe,
+        [CHAR_QUOTE] = &&quote,
+        [CHAR_DOUBLE_QUOTE] = &&doubleQuote,
+        [CHAR_WHITESPACE] = &&invalid,
+        [CHAR_INVALID] = &&invalid
+    };
+
+    goto *handlers[charClasses[c]];
+#else
+    switch (charClasses[c]) {
+        case CHAR_ALPHA: goto alpha;
+        case CHAR_DIGIT: goto digit;
+        case CHAR_END: goto eof;
+        case CHAR_PUNCTUATION: goto punctuation;
+        case CHAR_OPERATOR: goto operator;
+        case CHAR_SLASH: goto slash;
+        case CHAR_AMPERSAND: goto ampersand;
+        case CHAR_PIPE: goto pipe;
+        case CHAR_QUOTE: goto quote;
+        case CHAR_DOUBLE_QUOTE: goto doubleQuote;
+        default: goto invalid;
+    }
+#endif
+
+alpha:
+    while (charClasses[(unsigned char) *end] <= CHAR_DIGIT) {
+        end++;
+    }
+
+    scanner->currentIndex = end - 1 - source;
+    type = makeKeyword(start, end - start);
+
+    if (type == TOKEN_IDENTIFIER && scanner->interning) {
+        Token token = makeToken(scanner, type);
+        token.value.identifier = internIdentifier(scanner->context->identifiers, start, end - start);
 
-    if (token != NULL) {
         return token;
     }
 
-    token = makeToken(TOKEN_IDENTIFIER);
-    token->value.string = identifier;
+    return makeToken(scanner, type);
 
-    return token;
+punctuation:
+    type = punctuationTokens[c];
+    goto emit;
+
+operator:
+    if (*end == '=') {
+        type = equalTokens[c];
+        end++;
+    } else {
+        type = punctuationTokens[c];
+    }
+
+    goto emit;
+
+eof:
+    type = TOKEN_EOF;
+    goto emit;
+
+slash:
+    scanner->currentIndex = end - source;
+
+    switch (*end) {
+        case '=': return makeToken(scanner, TOKEN_SLASH_EQUAL);
+        case '/': return singleLineComment(scanner);
+        case '*': return multipleLinesComment(scanner);
+    }
+
+    type = TOKEN_SLASH;
+    goto emit;
+
+emit:
+    scanner->currentIndex = end - 1 - source;
+
+    return makeToken(scanner, type);
+
+digit:
+    scanner->currentIndex = start - source;
+
+    return makeNumber(scanner);
+
+ampersand:
+    scanner->currentIndex = start - source;
+
+    return makeToken(scanner, expect(scanner, '&', "Expect \"&&\" but received \"&%c\".") ? TOKEN_DOUBLE_AMPERSAND : TOKEN_NONE);
+
+pipe:
+    scanner->currentIndex = start - source;
+
+    return makeToken(scanner, expect(scanner, '|', "Expect \"||\" but received \"|%c\".") ? TOKEN_DOUBLE_PIPE : TOKEN_NONE);
+
+quote:
+    scanner->currentIndex = start - source;
+
+    return makeChar(scanner);
+
+doubleQuote:
+    scanner->currentIndex = start - source;
+
+    return makeString(scanner);
+
+invalid:
+    scanner->currentIndex = start - source;
+    addScanError(scanner, scanner->currentIndex, scanner->currentIndex + 1, "Unexpected character \"%c\".", c);
+
+    return makeToken(scanner, TOKEN_NONE);
 }
 
-static bool expect(char c, char* message)
+static bool scanNextToken(Scanner* scanner)
 {
-    if (!match(c)) {
-        addErrorAt(scanner->module, scanner->currentIndex + 1, scanner->currentIndex + 2, message, peekNext());
+    Token token = getToken(scanner);
+    advance(scanner);
 
+    if (token.type == TOKEN_EOF) {
         return false;
     }
 
+    if (token.type != TOKEN_NONE) {
+        pushTokenBuffer(scanner->tokens, token);
+    }
+
     return true;
 }
 
-static Token* makeChar()
+static void scanChunk(Scanner* scanner)
 {
-    advance();
-    Token* token = makeToken(TOKEN_CHAR);
-    token->value.c = peek();
-    expect('\'', "A character value must be closed with \"'\" but received \"%c\".");
+    while (!isAtEnd(scanner)) {
+        size_t resumeIndex = scanner->currentIndex;
+        skipWhitespaces(scanner);
 
-    return token;
+        if (scanner->currentIndex >= scanner->endIndex) {
+            scanner->currentIndex = resumeIndex;
+
+            return;
+        }
+
+        if (!scanNextToken(scanner)) {
+            return;
+        }
+    }
+}
+
+static void* scanChunkThread(void* scanner)
+{
+    scanChunk(scanner);
+
+    return NULL;
 }
 
-static Token* makeString()
+// A chunk is lexed speculatively from its first byte. Scanning only depends
+// on the current position, so once the sequential scanner starts a token
+// where the chunk also started one, the rest of the chunk is exactly what
+// the sequential scanner would produce. Until then (e.g. when the previous
+// chunk ended inside a comment or a string) the tokens are lexed again.
+static void stitchChunk(Scanner* scanner, Scanner* chunk)
 {
-    advance();
-    StringBuilder* builder = newStringBuilder();
-    char c;
+    TokenBuffer* tokens = chunk->tokens;
+    size_t next = 0;
+    size_t syncIndex = SIZE_MAX;
+
+    while (!isAtEnd(scanner)) {
+        size_t resumeIndex = scanner->currentIndex;
+        skipWhitespaces(scanner);
+
+        while (next < tokens->size && tokens->tokens[next].startIndex < scanner->currentIndex) {
+            next++;
+        }
+
+        if (next < tokens->size && tokens->tokens[next].startIndex == scanner->currentIndex) {
+            syncIndex = scanner->currentIndex;
+
+            for (size_t i = next; i < tokens->size; i++) {
+                Token token = tokens->tokens[i];
+
+                if (token.type == TOKEN_IDENTIFIER) {
+                    token.value.identifier = internIdentifier(scanner->context->identifiers, TOKEN_SOURCE(tokens, &token), token.length);
+                }
+
+                pushTokenBuffer(scanner->tokens, token);
+            }
+
+            scanner->startIndex = chunk->startIndex;
+            scanner->currentIndex = chunk->currentIndex;
+
+            break;
+        }
+
+        if (scanner->currentIndex >= chunk->endIndex) {
+            scanner->currentIndex = resumeIndex;
+
+            break;
+        }
+
+        if (!scanNextToken(scanner)) {
+            break;
+        }
+    }
+
+    for (VECTOR_EACH(chunk->errors)) {
+        ScanError* error = VECTOR_GET(chunk->errors, i);
+
+        if (error->tokenIndex >= syncIndex) {
+            pushVector(scanner->errors, error);
+        } else {
+            freeScanError(error);
+        }
+    }
+}
+
+static int countChunks(Module* module)
+{
+    long processors = 1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+    processors = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    size_t chunks = module->length / SCAN_CHUNK_MIN_SIZE;
+
+    if (chunks > processors) {
+        chunks = processors;
+    }
+
+    return chunks > SCAN_MAX_CHUNKS ? SCAN_MAX_CHUNKS : chunks;
+}
+
+static int splitChunks(Module* module, int chunkCount, size_t* boundaries)
+{
+    int count = 0;
+    boundaries[0] = 0;
+
+    for (int i = 1; i < chunkCount; i++) {
+        char* newLine = findCharacter(module->source + module->length / chunkCount * i, '\n');
+        size_t boundary = newLine - module->source + 1;
+
+        if (boundary > boundaries[count] && boundary < module->length) {
+            boundaries[++count] = boundary;
+        }
+    }
+
+    boundaries[++count] = SIZE_MAX;
+
+    return count;
+}
 
-    while (c = peek(scanner) != '"') {
-        addStringBuilder(builder, c);
-        advance();
+static void scanInParallel(Scanner* scanner, int chunkCount)
+{
+    Module* module = scanner->module;
+    size_t boundaries[SCAN_MAX_CHUNKS + 1];
+    Scanner* chunks[SCAN_MAX_CHUNKS];
+    pthread_t threads[SCAN_MAX_CHUNKS];
+    bool started[SCAN_MAX_CHUNKS];
+    int count = splitChunks(module, chunkCount, boundaries);
+
+    scanner->endIndex = boundaries[1];
+    chunks[0] = scanner;
+
+    for (int i = 1; i < count; i++) {
+        chunks[i] = newScanner(scanner->context, boundaries[i], boundaries[i + 1]);
+        chunks[i]->interning = false;
+        started[i] = !pthread_create(&threads[i], NULL, scanChunkThread, chunks[i]);
+
+        if (!started[i]) {
+            scanChunk(chunks[i]);
+        }
+    }
 
-        if (isAtEnd()) {
-            addErrorAt(scanner->module, scanner->currentIndex, scanner->currentIndex + 1, "A string value must be closed with '\"' but it's the end of the file.");
-            back();
+    scanChunk(scanner);
+    scanner->endIndex = SIZE_MAX;
 
-            return makeToken(TOKEN_NONE);
+    for (int i = 1; i < count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
         }
+
+        stitchChunk(scanner, chunks[i]);
+        freeTokenBuffer(chunks[i]->tokens);
+        freeScanner(chunks[i]);
+    }
+}
+
+static void reportScanErrors(Scanner* scanner)
+{
+    if (!VECTOR_SIZE(scanner->errors)) {
+        return;
+    }
+
+    ScanError* first = VECTOR_FIRST(scanner->errors);
+
+    while (scanner->tokens->size && scanner->tokens->tokens[scanner->tokens->size - 1].startIndex >= first->tokenIndex) {
+        scanner->tokens->size--;
+    }
+
+    for (VECTOR_EACH(scanner->errors)) {
+        ScanError* error = VECTOR_GET(scanner->errors, i);
+        addErrorAt(scanner->context, error->startIndex, error->endIndex, "%s", error->message);
+        freeScanError(error);
+    }
+}
+
+static Scanner* scanModule(CompilerContext* context)
+{
+    Scanner* scanner = newScanner(context, 0, SIZE_MAX);
+    int chunkCount = countChunks(context->module);
+
+    if (chunkCount > 1) {
+        scanInParallel(scanner, chunkCount);
+    } else {
+        scanChunk(scanner);
     }
 
-    Token* token = makeToken(TOKEN_STRING);
-    token->value.string = buildStringBuilder(builder);
-    freeStringBuilder(builder);
+    return scanner;
+}
+
+TokenBuffer* scan(CompilerContext* context)
+{
+    Scanner* scanner = scanModule(context);
+    reportScanErrors(scanner);
+    pushTokenBuffer(scanner->tokens, makeToken(scanner, TOKEN_EOF));
+    TokenBuffer* tokens = scanner->tokens;
+    freeScanner(scanner);
+
+    return tokens;
+}
+
+// Unlike scan, the tokens following an error are kept and the errors are
+// handed over instead of being reported, so that the buffer can be patched
+// by rescan when the module is edited.
+TokenBuffer* scanEditable(CompilerContext* context, Vector* errors)
+{
+    Scanner* scanner = scanModule(context);
+
+    for (VECTOR_EACH(scanner->errors)) {
+        pushVector(errors, VECTOR_GET(scanner->errors, i));
+    }
+
+    pushTokenBuffer(scanner->tokens, makeToken(scanner, TOKEN_EOF));
+    TokenBuffer* tokens = scanner->tokens;
+    freeScanner(scanner);
+
+    return tokens;
+}
+
+// Tokens of the tail are counted back from length.
+static Token getTokenAt(TokenBuffer* buffer, size_t index, size_t length)
+{
+    size_t gapStart = buffer->size - buffer->tailSize;
+
+    if (index < gapStart) {
+        return buffer->tokens[index];
+    }
+
+    Token token = buffer->tokens[index + buffer->capacity - buffer->size];
+    token.startIndex = length - token.startIndex;
 
     return token;
 }
 
-static Token* singleLineComment()
+static void moveGap(TokenBuffer* buffer, size_t index, size_t length)
 {
-    advance();
+    Token* tokens = buffer->tokens;
+    size_t gapSize = buffer->capacity - buffer->size;
+    size_t gapStart = buffer->size - buffer->tailSize;
+    index = index < buffer->size ? index : buffer->size;
+
+    for (; gapStart < index; gapStart++) {
+        tokens[gapStart] = tokens[gapStart + gapSize];
+        tokens[gapStart].startIndex = length - tokens[gapStart].startIndex;
+    }
 
-    while (peek() != '\n' && !isAtEnd()) {
-        advance();
+    for (; gapStart > index; gapStart--) {
+        tokens[gapStart - 1 + gapSize] = tokens[gapStart - 1];
+        tokens[gapStart - 1 + gapSize].startIndex = length - tokens[gapStart - 1].startIndex;
     }
 
-    return makeToken(TOKEN_NONE);
+    buffer->tailSize = buffer->size - gapStart;
 }
 
-static Token* multipleLinesComment()
+// Makes the tokens before index readable in place. The parser reads tokens
+// in order, so the gap only moves past the ones it reads.
+void moveTokenGap(TokenBuffer* buffer, size_t index)
 {
-    advance();
+    moveGap(buffer, index, buffer->module->length);
+}
 
-    while (!isAtEnd()) {
-        if (peek() == '*' && peekNext() == '/') {
-            advance();
+// The gap must be at index, with the removed tokens at the start of the
+// tail.
+static void spliceTokenBuffer(TokenBuffer* buffer, size_t index, size_t removed, TokenBuffer* added)
+{
+    size_t size = buffer->size - removed + added->size;
+    buffer->tailSize -= removed;
 
-            break;
+    if (size > buffer->capacity) {
+        size_t capacity = buffer->capacity;
+
+        while (size > buffer->capacity) {
+            buffer->capacity *= 2;
         }
 
-        advance();
+        buffer->tokens = safeRealloc(buffer->tokens, sizeof(Token) * buffer->capacity);
+        memmove(buffer->tokens + buffer->capacity - buffer->tailSize, buffer->tokens + capacity - buffer->tailSize, sizeof(Token) * buffer->tailSize);
     }
 
-    return makeToken(TOKEN_NONE);
+    memcpy(buffer->tokens + index, added->tokens, sizeof(Token) * added->size);
+    buffer->size = size;
 }
 
-static Token* getToken()
+// Errors are kept in source order, so the ones raised by the lexemes that
+// were scanned again form a contiguous run.
+static void spliceScanErrors(Vector* errors, Vector* added, size_t startIndex, size_t syncIndex, size_t delta)
 {
-    skipWhitespaces();
-    scanner->startIndex = scanner->currentIndex;
+    Vector* tail = newVector();
+
+    while (VECTOR_SIZE(errors) > 0 && ((ScanError*) VECTOR_LAST(errors))->tokenIndex >= startIndex) {
+        ScanError* error = popVector(errors);
+
+        if (error->tokenIndex < syncIndex) {
+            freeScanError(error);
+
+            continue;
+        }
 
-    if (isAtEnd()) {
-        return makeToken(TOKEN_EOF);
+        error->tokenIndex += delta;
+        error->startIndex += delta;
+        error->endIndex += delta;
+        pushVector(tail, error);
     }
 
-    char c = peek();
+    for (VECTOR_EACH(added)) {
+        pushVector(errors, VECTOR_GET(added, i));
+    }
 
-    if (isAlpha(c)) {
-        return makeIdentifier();
+    while (VECTOR_SIZE(tail) > 0) {
+        pushVector(errors, popVector(tail));
     }
 
-    if (isDigit(c)) {
-        return makeNumber();
+    freeVector(tail);
+}
+
+// Updates the tokens of a module whose bytes [startIndex, endIndex) were
+// replaced by length new ones. Lexing restarts at the last token that ends
+// safely before the edit, and stops as soon as a lexeme starts after the
+// edit where one also started before it: from there on, scanning produces
+// the old tokens again, moved by the size difference. These are left in
+// the tail, where they don't need to be moved.
+TokenEdit rescan(CompilerContext* context, TokenBuffer* tokens, Vector* errors, size_t startIndex, size_t endIndex, size_t length)
+{
+    size_t delta = length - (endIndex - startIndex);
+    size_t oldLength = context->module->length - delta;
+    size_t count = tokens->size - 1;
+    size_t low = 0;
+    size_t high = count;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        Token token = getTokenAt(tokens, middle, oldLength);
+
+        if (TOKEN_END_INDEX(&token) + SCAN_LOOKAHEAD <= startIndex) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
     }
 
-    switch (c) {
-        case '+': return makeToken(match('=') ? TOKEN_PLUS_EQUAL : TOKEN_PLUS);
-        case '-': return makeToken(match('=') ? TOKEN_MINUS_EQUAL : TOKEN_MINUS);
-        case '*': return makeToken(match('=') ? TOKEN_STAR_EQUAL : TOKEN_STAR);
-        case '/': {
-            if (match('=')) {
-                return makeToken(TOKEN_SLASH_EQUAL);
-            }
+    size_t first = low > 0 ? low - 1 : 0;
+    size_t relexIndex = low > 0 ? getTokenAt(tokens, first, oldLength).startIndex : 0;
+    moveGap(tokens, first, oldLength);
+    Scanner* scanner = newScanner(context, relexIndex, SIZE_MAX);
+    size_t next = first;
+    size_t sync = tokens->size;
+    size_t syncIndex = SIZE_MAX;
 
-            if (match('/')) {
-                return singleLineComment();
-            }
+    while (!isAtEnd(scanner)) {
+        skipWhitespaces(scanner);
+
+        if (scanner->currentIndex >= startIndex + length) {
+            size_t oldIndex = scanner->currentIndex - delta;
 
-            if (match('*')) {
-                return multipleLinesComment();
+            while (next < count && getTokenAt(tokens, next, oldLength).startIndex < oldIndex) {
+                next++;
             }
 
-            return makeToken(TOKEN_SLASH);
-        }
-        case '(': return makeToken(TOKEN_LEFT_PAREN);
-        case ')': return makeToken(TOKEN_RIGHT_PAREN);
-        case '{': return makeToken(TOKEN_LEFT_BRACE);
-        case '}': return makeToken(TOKEN_RIGHT_BRACE);
-        case ';': return makeToken(TOKEN_SEMILICON);
-        case '=': return makeToken(match('=') ? TOKEN_DOUBLE_EQUAL : TOKEN_EQUAL);
-        case '!': return makeToken(match('=') ? TOKEN_BANG_EQUAL : TOKEN_BANG);
-        case '<': return makeToken(match('=') ? TOKEN_LESS_EQUAL : TOKEN_LESS);
-        case '>': return makeToken(match('=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
-        case '.': return makeToken(TOKEN_DOT);
-        case ',': return makeToken(TOKEN_COMMA);
-        case '^': return makeToken(TOKEN_CIRCUMFLEX);
-        case '&': return makeToken(expect('&', "Expect \"&&\" but received \"&%c\".") ? TOKEN_DOUBLE_AMPERSAND : TOKEN_NONE);
-        case '|': return makeToken(expect('|', "Expect \"||\" but received \"|%c\".") ? TOKEN_DOUBLE_PIPE : TOKEN_NONE);
-        case '?': return makeToken(TOKEN_QUESTION_MARK);
-        case '%': return makeToken(match('=') ? TOKEN_MODULO_EQUAL : TOKEN_MODULO);
-        case '[': return makeToken(TOKEN_LEFT_BRACKET);
-        case ']': return makeToken(TOKEN_RIGHT_BRACKET);
-        case '\'': return makeChar();
-        case '"': return makeString();
-        case '#': return makeToken(TOKEN_HASHTAG);
-        case ':': return makeToken(TOKEN_COLON);
-    }
-
-    addErrorAt(scanner->module, scanner->currentIndex, scanner->currentIndex + 1, "Unexpected character \"%c\".", c);
-
-    return makeToken(TOKEN_NONE);
-}
-
-Vector* scan(Module* module)
-{
-    scanner = newScanner(module);
-
-    while (!isAtEnd()) {
-        Token* token = getToken();
-        advance();
-
-        if (token->type == TOKEN_NONE || hasErrors()) {
-            if (token->type == TOKEN_EOF) {
+            if (next < count && getTokenAt(tokens, next, oldLength).startIndex == oldIndex) {
+                sync = next;
+                syncIndex = oldIndex;
+
                 break;
             }
-
-            continue;
         }
 
-        if (token->type == TOKEN_EOF) {
+        if (!scanNextToken(scanner)) {
             break;
         }
+    }
 
-        pushVector(scanner->tokens, token);
+    if (sync == tokens->size) {
+        pushTokenBuffer(scanner->tokens, makeToken(scanner, TOKEN_EOF));
     }
-    
-    pushVector(scanner->tokens, makeToken(TOKEN_EOF));
-    Vector* tokens = scanner->tokens;
-    free(scanner);
 
-    return tokens;
+    TokenEdit edit = {first, sync - first, scanner->tokens->size};
+    spliceTokenBuffer(tokens, first, sync - first, scanner->tokens);
+    spliceScanErrors(errors, scanner->errors, relexIndex, syncIndex, delta);
+    freeTokenBuffer(scanner->tokens);
+    freeScanner(scanner);
+
+    return edit;
 }
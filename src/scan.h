@@ -2,7 +2,10 @@
 #define OPAL_SCAN_H
 
 #include "module.h"
+#include "context.h"
 #include "vector.h"
+#include <stddef.h>
+#include <stdint.h>
 
 typedef enum {
     // SIGNS
@@ -72,20 +75,54 @@ typedef enum {
     TOKEN_NONE
 } TokenType;
 
+#define TOKEN_END_INDEX(token) ((token)->startIndex + (token)->length)
+#define TOKEN_SOURCE(buffer, token) ((buffer)->module->source + (token)->startIndex)
+
 typedef struct {
     TokenType type;
     union {
-        int integer;
+        int64_t integer;
         char c;
-        float _float;
-        char* string;
+        double _float;
+        int identifier;
     } value;
 
-    Module* module;
-    int startIndex;
-    int endIndex;
+    size_t startIndex;
+    size_t length;
 } Token;
 
-Vector* scan(Module* module);
+// The last tailSize tokens of an edited buffer are kept at the end of the
+// array, after a gap, with their startIndex counted back from the end of
+// the module, so that edits before them neither move nor shift them.
+typedef struct {
+    Module* module;
+    Token* tokens;
+    size_t size;
+    size_t capacity;
+    size_t tailSize;
+} TokenBuffer;
+
+// tokenIndex is where the lexeme that raised the error starts.
+typedef struct {
+    size_t tokenIndex;
+    size_t startIndex;
+    size_t endIndex;
+    char* message;
+} ScanError;
+
+// Tokens [firstToken, firstToken + removedTokens) were replaced by
+// addedTokens new ones.
+typedef struct {
+    size_t firstToken;
+    size_t removedTokens;
+    size_t addedTokens;
+} TokenEdit;
+
+TokenBuffer* scan(CompilerContext* context);
+TokenBuffer* scanEditable(CompilerContext* context, Vector* errors);
+TokenEdit rescan(CompilerContext* context, TokenBuffer* tokens, Vector* errors, size_t startIndex, size_t endIndex, size_t length);
+void moveTokenGap(TokenBuffer* buffer, size_t index);
+void freeTokenBuffer(TokenBuffer* buffer);
+void freeScanError(ScanError* error);
 
 #endif
@@ -0,0 +1,823 @@
+#include "server.h"
+#include "module.h"
+#include "parse.h"
+#include "error.h"
+#include "util.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DOCUMENT_STATEMENTS_INITIAL_CAPACITY 64
+#define STATEMENT_MENTIONS_INITIAL_CAPACITY 4
+#define DOCUMENT_GARBAGE_FACTOR 2
+#define DOCUMENT_MIN_GARBAGE 65536
+#define SERVER_LINE_SIZE 4096
+
+static Statement* newStatement()
+{
+    Statement* statement = safeMalloc(sizeof(Statement));
+    statement->firstToken = 0;
+    statement->tokenCount = 0;
+    statement->node = NODE_NONE;
+    statement->firstNode = 0;
+    statement->endNode = 0;
+    statement->declares = false;
+    statement->mentions = safeMalloc(sizeof(int) * STATEMENT_MENTIONS_INITIAL_CAPACITY);
+    statement->mentionCount = 0;
+    statement->mentionCapacity = STATEMENT_MENTIONS_INITIAL_CAPACITY;
+    statement->errors = newVector();
+    statement->foldErrors = newVector();
+    statement->pending = false;
+    statement->shifted = false;
+
+    return statement;
+}
+
+static void clearErrors(Vector* errors)
+{
+    while (VECTOR_SIZE(errors) > 0) {
+        freeError(popVector(errors));
+    }
+}
+
+static void clearStatement(Statement* statement)
+{
+    clearErrors(statement->errors);
+    clearErrors(statement->foldErrors);
+    statement->mentionCount = 0;
+    statement->declares = false;
+}
+
+static void freeStatement(Statement* statement)
+{
+    clearStatement(statement);
+    freeVector(statement->errors);
+    freeVector(statement->foldErrors);
+    free(statement->mentions);
+    free(statement);
+}
+
+static void addMention(Statement* statement, int name)
+{
+    for (int i = 0; i < statement->mentionCount; i++) {
+        if (statement->mentions[i] == name) {
+            return;
+        }
+    }
+
+    if (statement->mentionCount == statement->mentionCapacity) {
+        statement->mentionCapacity *= 2;
+        statement->mentions = safeRealloc(statement->mentions, sizeof(int) * statement->mentionCapacity);
+    }
+
+    statement->mentions[statement->mentionCount++] = name;
+}
+
+static size_t getFirstToken(Document* document, Statement* statement)
+{
+    return statement->firstToken + (statement->shifted ? document->shiftTokens : 0);
+}
+
+// Returns the position of the first statement starting at or after
+// firstToken in a vector of statements ordered by their first token.
+static int findStatement(Document* document, Vector* statements, size_t firstToken)
+{
+    int low = 0;
+    int high = VECTOR_SIZE(statements);
+
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+
+        if (getFirstToken(document, VECTOR_GET(statements, middle)) < firstToken) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+static void insertStatement(Document* document, Vector* statements, Statement* statement)
+{
+    int position = findStatement(document, statements, getFirstToken(document, statement));
+    pushVector(statements, statement);
+    memmove(statements->items + position + 1, statements->items + position, sizeof(void*) * (VECTOR_SIZE(statements) - 1 - position));
+    VECTOR_GET(statements, position) = statement;
+}
+
+static void removeStatement(Document* document, Vector* statements, Statement* statement)
+{
+    int position = findStatement(document, statements, getFirstToken(document, statement));
+    memmove(statements->items + position, statements->items + position + 1, sizeof(void*) * (VECTOR_SIZE(statements) - 1 - position));
+    statements->size--;
+}
+
+static Vector* getNameStatements(Document* document, Map* map, int name)
+{
+    Vector* statements = getMap(map, name);
+
+    if (statements == NULL) {
+        statements = newVector();
+        setMap(map, name, statements);
+        pushVector(document->indexes, statements);
+    }
+
+    return statements;
+}
+
+// Returns the last declaration of name in a statement starting before
+// firstToken.
+static Variable* findDeclaration(Document* document, int name, size_t firstToken)
+{
+    Vector* declarers = getMap(document->declarers, name);
+
+    if (declarers == NULL) {
+        return NULL;
+    }
+
+    int position = findStatement(document, declarers, firstToken);
+
+    return position > 0 ? &((Statement*) VECTOR_GET(declarers, position - 1))->variable : NULL;
+}
+
+// Statements are parsed with an environment of their own, so every name
+// they read comes from another statement and is recorded as a mention.
+static Variable* resolveDeclaration(void* data, int name)
+{
+    Document* document = data;
+    Statement* statement = document->current;
+    addMention(statement, name);
+
+    return findDeclaration(document, name, getFirstToken(document, statement));
+}
+
+static void indexStatement(Document* document, Statement* statement)
+{
+    if (statement->declares) {
+        insertStatement(document, getNameStatements(document, document->declarers, statement->variable.name), statement);
+    }
+
+    for (int i = 0; i < statement->mentionCount; i++) {
+        insertStatement(document, getNameStatements(document, document->readers, statement->mentions[i]), statement);
+    }
+
+    if (VECTOR_SIZE(statement->errors) > 0 || VECTOR_SIZE(statement->foldErrors) > 0) {
+        insertStatement(document, document->erroneous, statement);
+    }
+
+    document->parseErrorCount += VECTOR_SIZE(statement->errors);
+    document->liveNodes += statement->endNode - statement->firstNode;
+}
+
+static void unindexStatement(Document* document, Statement* statement)
+{
+    if (statement->declares) {
+        removeStatement(document, getMap(document->declarers, statement->variable.name), statement);
+    }
+
+    for (int i = 0; i < statement->mentionCount; i++) {
+        removeStatement(document, getMap(document->readers, statement->mentions[i]), statement);
+    }
+
+    if (VECTOR_SIZE(statement->errors) > 0 || VECTOR_SIZE(statement->foldErrors) > 0) {
+        removeStatement(document, document->erroneous, statement);
+    }
+
+    if (statement->pending) {
+        removeStatement(document, document->pending, statement);
+        statement->pending = false;
+    }
+
+    document->parseErrorCount -= VECTOR_SIZE(statement->errors);
+    document->liveNodes -= statement->endNode - statement->firstNode;
+}
+
+static void parseDocumentStatement(Document* document, Statement* statement, size_t* index)
+{
+    CompilerContext* context = document->context;
+    Vector* errors = context->errors;
+    Environment* environment = newEnvironment();
+    environment->resolve = resolveDeclaration;
+    environment->resolveData = document;
+    document->current = statement;
+    statement->firstToken = *index;
+    statement->shifted = false;
+    statement->firstNode = document->ast->size;
+
+    context->errors = statement->errors;
+    statement->node = parseStatement(context, document->tokens, document->ast, environment, index);
+    statement->endNode = document->ast->size;
+    context->errors = statement->foldErrors;
+    optimizeNodes(context, document->ast, statement->firstNode, statement->endNode);
+    context->errors = errors;
+
+    statement->tokenCount = *index - statement->firstToken;
+    statement->declares = VECTOR_SIZE(environment->declarations) > 0;
+
+    if (statement->declares) {
+        statement->variable = *(Variable*) VECTOR_FIRST(environment->declarations);
+        statement->variable.shadowed = NULL;
+    }
+
+    freeEnvironment(environment);
+}
+
+static void spliceStatements(Document* document, size_t index, size_t removed, Vector* added)
+{
+    size_t count = document->statementCount - removed + VECTOR_SIZE(added);
+
+    if (count > document->statementCapacity) {
+        while (count > document->statementCapacity) {
+            document->statementCapacity *= 2;
+        }
+
+        document->statements = safeRealloc(document->statements, sizeof(Statement*) * document->statementCapacity);
+    }
+
+    Statement** statements = document->statements;
+    memmove(statements + index + VECTOR_SIZE(added), statements + index + removed, sizeof(Statement*) * (document->statementCount - index - removed));
+
+    for (VECTOR_EACH(added)) {
+        statements[index + i] = VECTOR_GET(added, i);
+    }
+
+    document->statementCount = count;
+}
+
+static void moveErrors(Vector* errors, size_t delta)
+{
+    for (VECTOR_EACH(errors)) {
+        Error* error = VECTOR_GET(errors, i);
+        error->startIndex += delta;
+        error->endIndex += delta;
+    }
+}
+
+static void moveStatement(Document* document, Statement* statement, size_t tokenDelta, size_t delta)
+{
+    Span* spans = document->ast->spans;
+    statement->firstToken += tokenDelta;
+
+    for (NodeIndex node = statement->firstNode; node < statement->endNode; node++) {
+        spans[node].startIndex += delta;
+        spans[node].endIndex += delta;
+    }
+
+    moveErrors(statement->errors, delta);
+    moveErrors(statement->foldErrors, delta);
+}
+
+// The statements from shiftStart on are only moved by shiftTokens and
+// shiftBytes when read, so that an edit only moves the statements between
+// it and the previous one.
+static void moveShift(Document* document, size_t index)
+{
+    Statement** statements = document->statements;
+
+    while (document->shiftStart < index) {
+        Statement* statement = statements[document->shiftStart++];
+        moveStatement(document, statement, document->shiftTokens, document->shiftBytes);
+        statement->shifted = false;
+    }
+
+    while (document->shiftStart > index) {
+        Statement* statement = statements[--document->shiftStart];
+        moveStatement(document, statement, -document->shiftTokens, -document->shiftBytes);
+        statement->shifted = true;
+    }
+}
+
+static void patchLoads(Document* document, Statement* statement, int name, NodeIndex declaration)
+{
+    Ast* ast = document->ast;
+
+    for (NodeIndex node = statement->firstNode; node < statement->endNode; node++) {
+        if (ast->types[node] == NODE_LOAD && ast->values[node] == name) {
+            ast->left[node] = declaration;
+        }
+    }
+}
+
+static void queueStatement(Document* document, Statement* statement)
+{
+    if (!statement->pending) {
+        statement->pending = true;
+        insertStatement(document, document->pending, statement);
+    }
+}
+
+// Loads of a constant initialized with a literal were replaced by a copy
+// of it when they were folded.
+static bool isPropagated(Ast* ast, Variable* variable)
+{
+    NodeIndex value = ast->left[variable->declaration];
+
+    return value != NODE_NONE && (ast->types[value] == NODE_INTEGER || ast->types[value] == NODE_BOOLEAN);
+}
+
+static bool isSameValue(Ast* ast, Variable* before, Variable* after)
+{
+    if (!isPropagated(ast, before) || !isPropagated(ast, after)) {
+        return !isPropagated(ast, before) && !isPropagated(ast, after);
+    }
+
+    NodeIndex first = ast->left[before->declaration];
+    NodeIndex second = ast->left[after->declaration];
+
+    return ast->types[first] == ast->types[second] && ast->values[first] == ast->values[second];
+}
+
+// The declaration of name visible from endToken changed from before to
+// after. Statements reading it, up to the next one declaring it again, are
+// parsed again when its type, propagated value or existence changed, and
+// only relinked to the new declaration node otherwise.
+static void propagateDeclaration(Document* document, int name, size_t endToken, Variable* before, Variable* after)
+{
+    if (before == after || (before != NULL && after != NULL && before->type == after->type && before->declaration == after->declaration)) {
+        return;
+    }
+
+    Vector* readers = getMap(document->readers, name);
+    Vector* declarers = getMap(document->declarers, name);
+    size_t limit = SIZE_MAX;
+    bool changed = before == NULL || after == NULL || before->type != after->type || !isSameValue(document->ast, before, after);
+
+    if (readers == NULL) {
+        return;
+    }
+
+    if (declarers != NULL) {
+        int position = findStatement(document, declarers, endToken);
+
+        if (position < VECTOR_SIZE(declarers)) {
+            limit = getFirstToken(document, VECTOR_GET(declarers, position));
+        }
+    }
+
+    for (int i = findStatement(document, readers, endToken); i < VECTOR_SIZE(readers); i++) {
+        Statement* reader = VECTOR_GET(readers, i);
+
+        if (getFirstToken(document, reader) > limit) {
+            break;
+        }
+
+        if (changed) {
+            queueStatement(document, reader);
+        } else {
+            patchLoads(document, reader, name, after->declaration);
+        }
+    }
+}
+
+// The statements in removed were replaced by the ones in added, which
+// cover the tokens [startToken, endToken).
+static void compareDeclarations(Document* document, Vector* removed, Vector* added, size_t startToken, size_t endToken)
+{
+    Map* compared = newMap();
+    Vector* groups[] = {removed, added};
+
+    for (int group = 0; group < 2; group++) {
+        for (VECTOR_EACH(groups[group])) {
+            Statement* statement = VECTOR_GET(groups[group], i);
+            int name = statement->variable.name;
+
+            if (!statement->declares || getMap(compared, name) != NULL) {
+                continue;
+            }
+
+            setMap(compared, name, statement);
+            Variable* before = findDeclaration(document, name, startToken);
+
+            for (int j = 0; j < VECTOR_SIZE(removed); j++) {
+                Statement* old = VECTOR_GET(removed, j);
+
+                if (old->declares && old->variable.name == name) {
+                    before = &old->variable;
+                }
+            }
+
+            propagateDeclaration(document, name, endToken, before, findDeclaration(document, name, endToken));
+        }
+    }
+
+    freeMap(compared);
+}
+
+static void parseDocument(Document* document)
+{
+    CompilerContext* context = document->context;
+    Vector* statements = newVector();
+
+    for (size_t i = 0; i < document->statementCount; i++) {
+        freeStatement(document->statements[i]);
+    }
+
+    for (VECTOR_EACH(document->indexes)) {
+        Vector* index = VECTOR_GET(document->indexes, i);
+
+        while (VECTOR_SIZE(index) > 0) {
+            popVector(index);
+        }
+    }
+
+    while (VECTOR_SIZE(document->erroneous) > 0) {
+        popVector(document->erroneous);
+    }
+
+    document->statementCount = 0;
+    document->parseErrorCount = 0;
+    document->liveNodes = 0;
+    resetArena(context->arena);
+    document->ast = newAst(context->arena, document->tokens->size + 1);
+    size_t index = 0;
+
+    while (index < document->tokens->size - 1) {
+        Statement* statement = newStatement();
+        parseDocumentStatement(document, statement, &index);
+        indexStatement(document, statement);
+        pushVector(statements, statement);
+    }
+
+    spliceStatements(document, 0, 0, statements);
+    document->shiftStart = document->statementCount;
+    document->shiftTokens = 0;
+    document->shiftBytes = 0;
+    freeVector(statements);
+}
+
+// Parses again the count statements starting at first, which were already
+// unindexed, and the following ones until a new statement starts where an
+// old one did: from there on the old statements are kept. How many tokens
+// a statement covers can depend on whether the names it reads are
+// declared.
+static void parseStatements(Document* document, size_t first, size_t count)
+{
+    moveShift(document, first);
+    Statement** statements = document->statements;
+    size_t statementCount = document->statementCount;
+    size_t startToken = first < statementCount ? getFirstToken(document, statements[first]) : 0;
+    size_t index = startToken;
+    size_t next = first;
+    Vector* removed = newVector();
+    Vector* added = newVector();
+
+    while (next < first + count) {
+        pushVector(removed, statements[next]);
+        next++;
+    }
+
+    while (true) {
+        bool atEnd = index >= document->tokens->size - 1;
+
+        while (next < statementCount && (getFirstToken(document, statements[next]) < index || atEnd)) {
+            unindexStatement(document, statements[next]);
+            pushVector(removed, statements[next]);
+            next++;
+        }
+
+        if (atEnd || (next < statementCount && getFirstToken(document, statements[next]) == index)) {
+            break;
+        }
+
+        Statement* statement = newStatement();
+        parseDocumentStatement(document, statement, &index);
+        indexStatement(document, statement);
+        pushVector(added, statement);
+    }
+
+    spliceStatements(document, first, next - first, added);
+    document->shiftStart = first + VECTOR_SIZE(added);
+    compareDeclarations(document, removed, added, startToken, index);
+
+    for (VECTOR_EACH(removed)) {
+        freeStatement(VECTOR_GET(removed, i));
+    }
+
+    freeVector(removed);
+    freeVector(added);
+}
+
+// Returns the first statement reading the token at index or one after it.
+static size_t findReadingStatement(Document* document, size_t index)
+{
+    size_t low = 0;
+    size_t high = document->statementCount;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        Statement* statement = document->statements[middle];
+
+        if (getFirstToken(document, statement) + statement->tokenCount < index) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+// Statements reading a replaced token are parsed again, the following ones
+// are moved. The statements reading a declaration whose type or value
+// changed are then parsed again in source order, as they may change the
+// declarations read further on.
+static void parseEdit(Document* document, TokenEdit edit, size_t delta)
+{
+    size_t damageEnd = edit.firstToken + (edit.removedTokens > 0 ? edit.removedTokens : 1);
+    size_t first = findReadingStatement(document, edit.firstToken);
+    size_t next = first;
+
+    while (next < document->statementCount && getFirstToken(document, document->statements[next]) < damageEnd) {
+        unindexStatement(document, document->statements[next]);
+        next++;
+    }
+
+    moveShift(document, next);
+    document->shiftTokens += edit.addedTokens - edit.removedTokens;
+    document->shiftBytes += delta;
+
+    parseStatements(document, first, next - first);
+
+    while (VECTOR_SIZE(document->pending) > 0) {
+        Statement* statement = VECTOR_FIRST(document->pending);
+        unindexStatement(document, statement);
+        parseStatements(document, findReadingStatement(document, getFirstToken(document, statement) + statement->tokenCount), 1);
+    }
+}
+
+// Encoding errors are kept in source order.
+static void editEncodingErrors(Document* document, size_t startIndex, size_t length, size_t delta)
+{
+    CompilerContext* context = document->context;
+    Vector* errors = context->errors;
+    Vector* tail = newVector();
+    size_t start = startIndex;
+    size_t end = startIndex + length;
+
+    context->errors = newVector();
+    revalidateEncoding(context, context->module, &start, &end);
+    Vector* added = context->errors;
+    context->errors = errors;
+
+    while (VECTOR_SIZE(document->encodingErrors) > 0 && ((Error*) VECTOR_LAST(document->encodingErrors))->startIndex >= start) {
+        Error* error = popVector(document->encodingErrors);
+
+        if (error->startIndex < end - delta) {
+            freeError(error);
+
+            continue;
+        }
+
+        error->startIndex += delta;
+        error->endIndex += delta;
+        pushVector(tail, error);
+    }
+
+    for (VECTOR_EACH(added)) {
+        pushVector(document->encodingErrors, VECTOR_GET(added, i));
+    }
+
+    while (VECTOR_SIZE(tail) > 0) {
+        pushVector(document->encodingErrors, popVector(tail));
+    }
+
+    freeVector(added);
+    freeVector(tail);
+}
+
+// Takes ownership of source, which must be followed by two '\0' bytes.
+Document* openDocument(CompilerContext* context, char* name, char* source, size_t length)
+{
+    Document* document = safeMalloc(sizeof(Document));
+    document->context = context;
+    document->statements = safeMalloc(sizeof(Statement*) * DOCUMENT_STATEMENTS_INITIAL_CAPACITY);
+    document->statementCount = 0;
+    document->statementCapacity = DOCUMENT_STATEMENTS_INITIAL_CAPACITY;
+    document->declarers = newMap();
+    document->readers = newMap();
+    document->indexes = newVector();
+    document->erroneous = newVector();
+    document->pending = newVector();
+    document->encodingErrors = newVector();
+    document->scanErrors = newVector();
+    document->current = NULL;
+    document->shiftStart = 0;
+    document->shiftTokens = 0;
+    document->shiftBytes = 0;
+    context->module = newModuleFromSource(name, source, length);
+
+    size_t start = 0;
+    size_t end = length;
+    Vector* errors = context->errors;
+    context->errors = document->encodingErrors;
+    revalidateEncoding(context, context->module, &start, &end);
+    context->errors = errors;
+
+    document->tokens = scanEditable(context, document->scanErrors);
+    parseDocument(document);
+
+    return document;
+}
+
+// Replaces the bytes [startIndex, endIndex) with text. Only the damaged
+// tokens are lexed again and only the statements reading them or a
+// declaration whose type or value changed are parsed again. Replaced nodes
+// stay in the AST until they outnumber the live ones, when everything is
+// parsed again into a new one.
+void editDocument(Document* document, size_t startIndex, size_t endIndex, char* text, size_t length)
+{
+    CompilerContext* context = document->context;
+    size_t delta = length - (endIndex - startIndex);
+
+    editModule(context->module, startIndex, endIndex, text, length);
+    editEncodingErrors(document, startIndex, length, delta);
+    TokenEdit edit = rescan(context, document->tokens, document->scanErrors, startIndex, endIndex, length);
+    parseEdit(document, edit, delta);
+
+    if (document->ast->size > DOCUMENT_GARBAGE_FACTOR * document->liveNodes + DOCUMENT_MIN_GARBAGE) {
+        parseDocument(document);
+    }
+}
+
+static void writeError(Document* document, FILE* output, Error* error)
+{
+    char* text = renderError(document->context, error);
+    fprintf(output, "[ERROR] %s\n", text);
+    free(text);
+}
+
+// Reports what compiling the document would: its first encoding error, or
+// else the errors of the first of scanning, parsing and folding that
+// fails.
+int writeDiagnostics(Document* document, FILE* output)
+{
+    int count = 0;
+
+    if (VECTOR_SIZE(document->encodingErrors) > 0) {
+        fprintf(output, "diagnostics 1\n");
+        writeError(document, output, VECTOR_FIRST(document->encodingErrors));
+        count = 1;
+    } else if (VECTOR_SIZE(document->scanErrors) > 0) {
+        count = VECTOR_SIZE(document->scanErrors);
+        fprintf(output, "diagnostics %d\n", count);
+
+        for (VECTOR_EACH(document->scanErrors)) {
+            ScanError* scanError = VECTOR_GET(document->scanErrors, i);
+            Error error = {scanError->message, true, scanError->startIndex, scanError->endIndex};
+            writeError(document, output, &error);
+        }
+    } else {
+        bool parsing = document->parseErrorCount > 0;
+
+        for (VECTOR_EACH(document->erroneous)) {
+            Statement* statement = VECTOR_GET(document->erroneous, i);
+            Vector* errors = parsing ? statement->errors : statement->foldErrors;
+            count += VECTOR_SIZE(errors);
+        }
+
+        fprintf(output, "diagnostics %d\n", count);
+
+        for (VECTOR_EACH(document->erroneous)) {
+            Statement* statement = VECTOR_GET(document->erroneous, i);
+            Vector* errors = parsing ? statement->errors : statement->foldErrors;
+
+            size_t shift = statement->shifted ? document->shiftBytes : 0;
+
+            for (int j = 0; j < VECTOR_SIZE(errors); j++) {
+                Error* error = VECTOR_GET(errors, j);
+                Error moved = {error->message, error->located, error->startIndex + shift, error->endIndex + shift};
+                writeError(document, output, &moved);
+            }
+        }
+    }
+
+    fprintf(output, "end\n");
+
+    return count;
+}
+
+// The module itself belongs to the context.
+void freeDocument(Document* document)
+{
+    for (size_t i = 0; i < document->statementCount; i++) {
+        freeStatement(document->statements[i]);
+    }
+
+    for (VECTOR_EACH(document->indexes)) {
+        freeVector(VECTOR_GET(document->indexes, i));
+    }
+
+    for (VECTOR_EACH(document->encodingErrors)) {
+        freeError(VECTOR_GET(document->encodingErrors, i));
+    }
+
+    for (VECTOR_EACH(document->scanErrors)) {
+        freeScanError(VECTOR_GET(document->scanErrors, i));
+    }
+
+    free(document->statements);
+    freeMap(document->declarers);
+    freeMap(document->readers);
+    freeVector(document->indexes);
+    freeVector(document->erroneous);
+    freeVector(document->pending);
+    freeVector(document->encodingErrors);
+    freeVector(document->scanErrors);
+    freeTokenBuffer(document->tokens);
+    free(document);
+}
+
+static char* readText(FILE* input, size_t length)
+{
+    char* text = safeMalloc(length + 2);
+
+    if (fread(text, sizeof(char), length, input) != length) {
+        free(text);
+
+        return NULL;
+    }
+
+    text[length] = '\0';
+    text[length + 1] = '\0';
+
+    return text;
+}
+
+// Serves one document at a time over a line based protocol:
+//   open <length> <name>\n<length bytes>
+//   edit <start> <end> <length>\n<length bytes>
+//   quit
+// open and edit are answered with the diagnostics of the document.
+int serve(FILE* input, FILE* output, int maxNestingDepth)
+{
+    CompilerContext* context = NULL;
+    Document* document = NULL;
+    char* name = NULL;
+    char line[SERVER_LINE_SIZE];
+
+    while (fgets(line, sizeof(line), input) != NULL) {
+        char command[SERVER_LINE_SIZE];
+        size_t startIndex;
+        size_t endIndex;
+        size_t length;
+
+        if (sscanf(line, "open %zu %s", &length, command) == 2) {
+            char* source = readText(input, length);
+
+            if (source == NULL) {
+                fprintf(output, "error Failed to read the document.\n");
+
+                break;
+            }
+
+            if (document != NULL) {
+                freeDocument(document);
+                freeCompilerContext(context);
+                free(name);
+            }
+
+            name = format("%s", command);
+            context = newCompilerContext();
+            context->maxNestingDepth = maxNestingDepth;
+            document = openDocument(context, name, source, length);
+        } else if (sscanf(line, "edit %zu %zu %zu", &startIndex, &endIndex, &length) == 3) {
+            char* text = readText(input, length);
+
+            if (text == NULL) {
+                fprintf(output, "error Failed to read the edit.\n");
+
+                break;
+            }
+
+            if (document == NULL || startIndex > endIndex || endIndex > context->module->length) {
+                fprintf(output, "error Invalid edit.\n");
+                fflush(output);
+                free(text);
+
+                continue;
+            }
+
+            editDocument(document, startIndex, endIndex, text, length);
+            free(text);
+        } else if (!strcmp(line, "quit\n") || !strcmp(line, "quit")) {
+            break;
+        } else {
+            fprintf(output, "error Unknown command.\n");
+            fflush(output);
+
+            continue;
+        }
+
+        writeDiagnostics(document, output);
+        fflush(output);
+    }
+
+    if (document != NULL) {
+        freeDocument(document);
+        freeCompilerContext(context);
+        free(name);
+    }
+
+    return 0;
+}
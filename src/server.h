@@ -0,0 +1,68 @@
+#ifndef OPAL_SERVER_H
+#define OPAL_SERVER_H
+
+#include "context.h"
+#include "scan.h"
+#include "ast.h"
+#include "map.h"
+#include "symbol.h"
+#include "vector.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// A top-level statement of a document, with everything needed to keep it
+// when the document is edited elsewhere. It covers the tokens from
+// firstToken up to the next statement and reads one token past them.
+typedef struct {
+    size_t firstToken;
+    size_t tokenCount;
+    NodeIndex node;
+    NodeIndex firstNode;
+    NodeIndex endNode;
+    bool declares;
+    Variable variable;
+    int* mentions;
+    int mentionCount;
+    int mentionCapacity;
+    Vector* errors;
+    Vector* foldErrors;
+    bool pending;
+    bool shifted;
+} Statement;
+
+// A module kept in memory between edits. Statements are ordered by their
+// first token, and so are the statements declaring or reading each name
+// in declarers and readers, which are used to find the statements a
+// changed declaration affects. The statements from shiftStart on are
+// shifted: their tokens, nodes and errors are still to be moved by
+// shiftTokens and shiftBytes.
+typedef struct {
+    CompilerContext* context;
+    TokenBuffer* tokens;
+    Ast* ast;
+    Statement** statements;
+    size_t statementCount;
+    size_t statementCapacity;
+    Map* declarers;
+    Map* readers;
+    Vector* indexes;
+    Vector* erroneous;
+    Vector* pending;
+    Vector* encodingErrors;
+    Vector* scanErrors;
+    size_t parseErrorCount;
+    NodeIndex liveNodes;
+    Statement* current;
+    size_t shiftStart;
+    size_t shiftTokens;
+    size_t shiftBytes;
+} Document;
+
+Document* openDocument(CompilerContext* context, char* name, char* source, size_t length);
+void editDocument(Document* document, size_t startIndex, size_t endIndex, char* text, size_t length);
+int writeDiagnostics(Document* document, FILE* output);
+void freeDocument(Document* document);
+int serve(FILE* input, FILE* output, int maxNestingDepth);
+
+#endif
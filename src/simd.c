@@ -0,0 +1,235 @@
+#include "simd.h"
+#include "util.h"
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Every kernel stops at the '\0' terminating the source. The vector kernels
+// only issue aligned loads, which never cross a page boundary, so reading
+// around the terminator is safe for both heap and mapped sources.
+
+static char* skipWhitespaceRunScalar(char* string)
+{
+    while (isWhitespace(*string)) {
+        string++;
+    }
+
+    return string;
+}
+
+static char* findCharacterScalar(char* string, char c)
+{
+    while (*string != c && *string != '\0') {
+        string++;
+    }
+
+    return string;
+}
+
+static char* findNonAsciiScalar(char* string)
+{
+    while (*string != '\0' && (unsigned char) *string < 0x80) {
+        string++;
+    }
+
+    return string;
+}
+
+#ifdef SIMD_X86
+#define SSE2_WIDTH 16
+#define AVX2_WIDTH 32
+
+__attribute__((target("sse2")))
+static unsigned int whitespaceMaskSse2(__m128i chunk)
+{
+    __m128i spaces = _mm_or_si128(
+        _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')),
+        _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))
+    );
+    __m128i lines = _mm_or_si128(
+        _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')),
+        _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r'))
+    );
+
+    return _mm_movemask_epi8(_mm_or_si128(spaces, lines));
+}
+
+__attribute__((target("sse2")))
+static char* skipWhitespaceRunSse2(char* string)
+{
+    uintptr_t offset = (uintptr_t) string & (SSE2_WIDTH - 1);
+    char* block = string - offset;
+    unsigned int mask = ~whitespaceMaskSse2(_mm_load_si128((__m128i*) block)) & (0xFFFFu << offset) & 0xFFFFu;
+
+    while (!mask) {
+        block += SSE2_WIDTH;
+        mask = ~whitespaceMaskSse2(_mm_load_si128((__m128i*) block)) & 0xFFFFu;
+    }
+
+    return block + __builtin_ctz(mask);
+}
+
+__attribute__((target("sse2")))
+static unsigned int characterMaskSse2(__m128i chunk, __m128i c)
+{
+    __m128i found = _mm_or_si128(
+        _mm_cmpeq_epi8(chunk, c),
+        _mm_cmpeq_epi8(chunk, _mm_setzero_si128())
+    );
+
+    return _mm_movemask_epi8(found);
+}
+
+__attribute__((target("sse2")))
+static char* findCharacterSse2(char* string, char c)
+{
+    __m128i character = _mm_set1_epi8(c);
+    uintptr_t offset = (uintptr_t) string & (SSE2_WIDTH - 1);
+    char* block = string - offset;
+    unsigned int mask = characterMaskSse2(_mm_load_si128((__m128i*) block), character) & (0xFFFFu << offset);
+
+    while (!mask) {
+        block += SSE2_WIDTH;
+        mask = characterMaskSse2(_mm_load_si128((__m128i*) block), character);
+    }
+
+    return block + __builtin_ctz(mask);
+}
+
+__attribute__((target("sse2")))
+static char* findNonAsciiSse2(char* string)
+{
+    __m128i zero = _mm_setzero_si128();
+    uintptr_t offset = (uintptr_t) string & (SSE2_WIDTH - 1);
+    char* block = string - offset;
+    __m128i chunk = _mm_load_si128((__m128i*) block);
+    unsigned int mask = characterMaskSse2(chunk, zero) | _mm_movemask_epi8(chunk);
+    mask &= 0xFFFFu << offset;
+
+    while (!mask) {
+        block += SSE2_WIDTH;
+        chunk = _mm_load_si128((__m128i*) block);
+        mask = characterMaskSse2(chunk, zero) | _mm_movemask_epi8(chunk);
+    }
+
+    return block + __builtin_ctz(mask);
+}
+
+__attribute__((target("avx2")))
+static unsigned int whitespaceMaskAvx2(__m256i chunk)
+{
+    __m256i spaces = _mm256_or_si256(
+        _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' ')),
+        _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\t'))
+    );
+    __m256i lines = _mm256_or_si256(
+        _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n')),
+        _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\r'))
+    );
+
+    return _mm256_movemask_epi8(_mm256_or_si256(spaces, lines));
+}
+
+__attribute__((target("avx2")))
+static char* skipWhitespaceRunAvx2(char* string)
+{
+    uintptr_t offset = (uintptr_t) string & (AVX2_WIDTH - 1);
+    char* block = string - offset;
+    unsigned int mask = ~whitespaceMaskAvx2(_mm256_load_si256((__m256i*) block)) & (0xFFFFFFFFu << offset);
+
+    while (!mask) {
+        block += AVX2_WIDTH;
+        mask = ~whitespaceMaskAvx2(_mm256_load_si256((__m256i*) block));
+    }
+
+    return block + __builtin_ctz(mask);
+}
+
+__attribute__((target("avx2")))
+static unsigned int characterMaskAvx2(__m256i chunk, __m256i c)
+{
+    __m256i found = _mm256_or_si256(
+        _mm256_cmpeq_epi8(chunk, c),
+        _mm256_cmpeq_epi8(chunk, _mm256_setzero_si256())
+    );
+
+    return _mm256_movemask_epi8(found);
+}
+
+__attribute__((target("avx2")))
+static char* findCharacterAvx2(char* string, char c)
+{
+    __m256i character = _mm256_set1_epi8(c);
+    uintptr_t offset = (uintptr_t) string & (AVX2_WIDTH - 1);
+    char* block = string - offset;
+    unsigned int mask = characterMaskAvx2(_mm256_load_si256((__m256i*) block), character) & (0xFFFFFFFFu << offset);
+
+    while (!mask) {
+        block += AVX2_WIDTH;
+        mask = characterMaskAvx2(_mm256_load_si256((__m256i*) block), character);
+    }
+
+    return block + __builtin_ctz(mask);
+}
+
+__attribute__((target("avx2")))
+static char* findNonAsciiAvx2(char* string)
+{
+    __m256i zero = _mm256_setzero_si256();
+    uintptr_t offset = (uintptr_t) string & (AVX2_WIDTH - 1);
+    char* block = string - offset;
+    __m256i chunk = _mm256_load_si256((__m256i*) block);
+    unsigned int mask = characterMaskAvx2(chunk, zero) | _mm256_movemask_epi8(chunk);
+    mask &= 0xFFFFFFFFu << offset;
+
+    while (!mask) {
+        block += AVX2_WIDTH;
+        chunk = _mm256_load_si256((__m256i*) block);
+        mask = characterMaskAvx2(chunk, zero) | _mm256_movemask_epi8(chunk);
+    }
+
+    return block + __builtin_ctz(mask);
+}
+#endif
+
+static char* (*skipWhitespaceRunKernel)(char* string) = skipWhitespaceRunScalar;
+static char* (*findCharacterKernel)(char* string, char c) = findCharacterScalar;
+static char* (*findNonAsciiKernel)(char* string) = findNonAsciiScalar;
+
+// Kernels are picked before main() runs so that scanner threads only ever
+// read these pointers.
+__attribute__((constructor))
+static void selectKernels()
+{
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        skipWhitespaceRunKernel = skipWhitespaceRunAvx2;
+        findCharacterKernel = findCharacterAvx2;
+        findNonAsciiKernel = findNonAsciiAvx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        skipWhitespaceRunKernel = skipWhitespaceRunSse2;
+        findCharacterKernel = findCharacterSse2;
+        findNonAsciiKernel = findNonAsciiSse2;
+    }
+#endif
+}
+
+char* skipWhitespaceRun(char* string)
+{
+    return skipWhitespaceRunKernel(string);
+}
+
+char* findCharacter(char* string, char c)
+{
+    return findCharacterKernel(string, c);
+}
+
+char* findNonAscii(char* string)
+{
+    return findNonAsciiKernel(string);
+}
@@ -0,0 +1,8 @@
+#ifndef OPAL_SIMD_H
+#define OPAL_SIMD_H
+
+char* skipWhitespaceRun(char* string);
+char* findCharacter(char* string, char c);
+char* findNonAscii(char* string);
+
+#endif
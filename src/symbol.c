@@ -1,30 +1,75 @@
 #include "symbol.h"
 #include "util.h"
 
+#define ENVIRONMENT_SCOPES_INITIAL_CAPACITY 8
+
 Environment* newEnvironment()
 {
     Environment* environment = safeMalloc(sizeof(Environment));
     environment->variables = newMap();
+    environment->declarations = newVector();
+    environment->scopes = safeMalloc(sizeof(int) * ENVIRONMENT_SCOPES_INITIAL_CAPACITY);
+    environment->scopeCount = 0;
+    environment->scopeCapacity = ENVIRONMENT_SCOPES_INITIAL_CAPACITY;
+    environment->resolve = NULL;
+    environment->resolveData = NULL;
 
     return environment;
 }
 
-Variable* newEnvironmentVariable(Environment* environment, char* name, char* type)
+Variable* newEnvironmentVariable(Environment* environment, int name, TypeId type, NodeIndex declaration)
 {
     Variable* variable = safeMalloc(sizeof(Variable));
+    variable->name = name;
     variable->type = type;
+    variable->declaration = declaration;
+    variable->shadowed = getMap(environment->variables, name);
     setMap(environment->variables, name, variable);
+    pushVector(environment->declarations, variable);
 
     return variable;
 }
 
 void freeEnvironment(Environment* environment)
 {
+    for (VECTOR_EACH(environment->declarations)) {
+        free(VECTOR_GET(environment->declarations, i));
+    }
+
+    freeVector(environment->declarations);
     freeMap(environment->variables);
+    free(environment->scopes);
     free(environment);
 }
 
-Variable* getEnvironmentVariable(Environment* environment, char* name)
+Variable* getEnvironmentVariable(Environment* environment, int name)
 {
-    return getMap(environment->variables, name);
+    Variable* variable = getMap(environment->variables, name);
+
+    if (variable == NULL && environment->resolve != NULL) {
+        return environment->resolve(environment->resolveData, name);
+    }
+
+    return variable;
+}
+
+void pushEnvironmentScope(Environment* environment)
+{
+    if (environment->scopeCount == environment->scopeCapacity) {
+        environment->scopeCapacity *= 2;
+        environment->scopes = safeRealloc(environment->scopes, sizeof(int) * environment->scopeCapacity);
+    }
+
+    environment->scopes[environment->scopeCount++] = VECTOR_SIZE(environment->declarations);
+}
+
+void popEnvironmentScope(Environment* environment)
+{
+    int start = environment->scopes[--environment->scopeCount];
+
+    while (VECTOR_SIZE(environment->declarations) > start) {
+        Variable* variable = popVector(environment->declarations);
+        setMap(environment->variables, variable->name, variable->shadowed);
+        free(variable);
+    }
 }
@@ -2,20 +2,38 @@
 #define OPAL_SYMBOL_H
 
 #include "map.h"
+#include "vector.h"
+#include "ast.h"
 
-typedef struct Environment {
-    struct Environment* parent;
-    Map* variables;
-} Environment;
+typedef struct Variable {
+    int name;
+    TypeId type;
+    NodeIndex declaration;
+    struct Variable* shadowed;
+} Variable;
+
+typedef Variable* (*ResolveFunction)(void* data, int name);
 
+// A single map holds the innermost visible variable of each name. Every
+// declaration remembers the variable it shadows, so popping a scope only
+// has to restore the declarations made since the matching push. Names that
+// aren't declared in the environment are looked up through resolve, when
+// set, for declarations that were parsed separately.
 typedef struct {
-    char* type;
-    int offset;
-} Variable;
+    Map* variables;
+    Vector* declarations;
+    int* scopes;
+    int scopeCount;
+    int scopeCapacity;
+    ResolveFunction resolve;
+    void* resolveData;
+} Environment;
 
 Environment* newEnvironment();
-Variable* newEnvironmentVariable(Environment* environment, char* name, char* type);
+Variable* newEnvironmentVariable(Environment* environment, int name, TypeId type, NodeIndex declaration);
 void freeEnvironment(Environment* environment);
-Variable* getEnvironmentVariable(Environment* environment, char* name);
+Variable* getEnvironmentVariable(Environment* environment, int name);
+void pushEnvironmentScope(Environment* environment);
+void popEnvironmentScope(Environment* environment);
 
 #endif
@@ -0,0 +1,138 @@
+#include "type.h"
+#include "util.h"
+#include "stringbuilder.h"
+#include <string.h>
+
+#define TYPE_TABLE_INITIAL_CAPACITY 16
+#define POINTER_SIZE 4
+
+struct TypeTable {
+    Type* entries;
+    int size;
+    int capacity;
+};
+
+static TypeId addType(TypeTable* types, TypeKind kind, char* name, int size)
+{
+    if (types->size == types->capacity) {
+        types->capacity *= 2;
+        types->entries = safeRealloc(types->entries, sizeof(Type) * types->capacity);
+    }
+
+    Type* type = &types->entries[types->size];
+    type->kind = kind;
+    type->name = name;
+    type->size = size;
+    type->element = TYPE_NONE;
+    type->result = TYPE_NONE;
+    type->parameters = NULL;
+    type->parameterCount = 0;
+
+    return types->size++;
+}
+
+// The builtin types are registered first so that their ids match
+// BuiltinType.
+TypeTable* newTypeTable()
+{
+    TypeTable* types = safeMalloc(sizeof(TypeTable));
+    types->entries = safeMalloc(sizeof(Type) * TYPE_TABLE_INITIAL_CAPACITY);
+    types->size = 0;
+    types->capacity = TYPE_TABLE_INITIAL_CAPACITY;
+    addType(types, TYPE_KIND_NONE, strdup("<none>"), 0);
+    addType(types, TYPE_KIND_INTEGER, strdup("<integer>"), 4);
+    addType(types, TYPE_KIND_BOOLEAN, strdup("<boolean>"), 1);
+    addType(types, TYPE_KIND_NULL, strdup("<null>"), POINTER_SIZE);
+
+    return types;
+}
+
+Type* getType(TypeTable* types, TypeId type)
+{
+    return &types->entries[type];
+}
+
+char* getTypeName(TypeTable* types, TypeId type)
+{
+    return getType(types, type)->name;
+}
+
+int getTypeSize(TypeTable* types, TypeId type)
+{
+    return getType(types, type)->size;
+}
+
+TypeId getArrayType(TypeTable* types, TypeId element)
+{
+    for (TypeId i = 0; i < types->size; i++) {
+        Type* type = &types->entries[i];
+
+        if (type->kind == TYPE_KIND_ARRAY && type->element == element) {
+            return i;
+        }
+    }
+
+    TypeId array = addType(types, TYPE_KIND_ARRAY, format("%s[]", getTypeName(types, element)), POINTER_SIZE);
+    getType(types, array)->element = element;
+
+    return array;
+}
+
+static bool isSameFunctionType(Type* type, TypeId result, TypeId* parameters, int parameterCount)
+{
+    return type->kind == TYPE_KIND_FUNCTION &&
+        type->result == result &&
+        type->parameterCount == parameterCount &&
+        !memcmp(type->parameters, parameters, sizeof(TypeId) * parameterCount);
+}
+
+static char* makeFunctionTypeName(TypeTable* types, TypeId result, TypeId* parameters, int parameterCount)
+{
+    StringBuilder* builder = newStringBuilder();
+    addStringBuilder(builder, '(');
+
+    for (int i = 0; i < parameterCount; i++) {
+        if (i > 0) {
+            appendStringBuilder(builder, ", ");
+        }
+
+        appendStringBuilder(builder, getTypeName(types, parameters[i]));
+    }
+
+    appendStringBuilder(builder, ") -> ");
+    appendStringBuilder(builder, getTypeName(types, result));
+    char* name = buildStringBuilder(builder);
+    freeStringBuilder(builder);
+
+    return name;
+}
+
+TypeId getFunctionType(TypeTable* types, TypeId result, TypeId* parameters, int parameterCount)
+{
+    for (TypeId i = 0; i < types->size; i++) {
+        if (isSameFunctionType(&types->entries[i], result, parameters, parameterCount)) {
+            return i;
+        }
+    }
+
+    char* name = makeFunctionTypeName(types, result, parameters, parameterCount);
+    TypeId function = addType(types, TYPE_KIND_FUNCTION, name, POINTER_SIZE);
+    Type* type = getType(types, function);
+    type->result = result;
+    type->parameterCount = parameterCount;
+    type->parameters = safeMalloc(sizeof(TypeId) * (parameterCount > 0 ? parameterCount : 1));
+    memcpy(type->parameters, parameters, sizeof(TypeId) * parameterCount);
+
+    return function;
+}
+
+void freeTypeTable(TypeTable* types)
+{
+    for (int i = 0; i < types->size; i++) {
+        free(types->entries[i].name);
+        free(types->entries[i].parameters);
+    }
+
+    free(types->entries);
+    free(types);
+}
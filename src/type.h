@@ -0,0 +1,44 @@
+#ifndef OPAL_TYPE_H
+#define OPAL_TYPE_H
+
+#include <stdint.h>
+
+typedef uint16_t TypeId;
+
+typedef enum {
+    TYPE_NONE,
+    TYPE_INTEGER,
+    TYPE_BOOLEAN,
+    TYPE_NULL
+} BuiltinType;
+
+typedef enum {
+    TYPE_KIND_NONE,
+    TYPE_KIND_INTEGER,
+    TYPE_KIND_BOOLEAN,
+    TYPE_KIND_NULL,
+    TYPE_KIND_ARRAY,
+    TYPE_KIND_FUNCTION
+} TypeKind;
+
+typedef struct {
+    TypeKind kind;
+    char* name;
+    int size;
+    TypeId element;
+    TypeId result;
+    TypeId* parameters;
+    int parameterCount;
+} Type;
+
+typedef struct TypeTable TypeTable;
+
+TypeTable* newTypeTable();
+Type* getType(TypeTable* types, TypeId type);
+char* getTypeName(TypeTable* types, TypeId type);
+int getTypeSize(TypeTable* types, TypeId type);
+TypeId getArrayType(TypeTable* types, TypeId element);
+TypeId getFunctionType(TypeTable* types, TypeId result, TypeId* parameters, int parameterCount);
+void freeTypeTable(TypeTable* types);
+
+#endif
@@ -5,6 +5,11 @@
 #include <string.h>
 #include "stringbuilder.h"
 
+// Counted per thread for the time report, as compilations on different
+// threads share nothing.
+static _Thread_local size_t allocationCount = 0;
+static _Thread_local size_t allocatedBytes = 0;
+
 static void* safeAlloc(void* pointer)
 {
     if (pointer == NULL) {
@@ -16,23 +21,48 @@ static void* safeAlloc(void* pointer)
 
 void* safeMalloc(size_t size)
 {
+    allocationCount++;
+    allocatedBytes += size;
+
     return safeAlloc(malloc(size));
 }
 
 void* safeRealloc(void* block, size_t size)
 {
+    allocationCount++;
+    allocatedBytes += size;
+
     return safeAlloc(realloc(block, size));
 }
 
+void getAllocationCounts(size_t* count, size_t* bytes)
+{
+    *count = allocationCount;
+    *bytes = allocatedBytes;
+}
+
+// Messages quote source lines, which can be arbitrarily long, so the
+// result is sized by a first measuring pass.
+char* formatArguments(char* format, va_list args)
+{
+    va_list copy;
+    va_copy(copy, args);
+    int length = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    char* buffer = safeMalloc(length + 1);
+    vsnprintf(buffer, length + 1, format, args);
+
+    return buffer;
+}
+
 char* format(char* format, ...)
 {
-    char buffer[2048];
     va_list args;
     va_start(args, format);
-    vsprintf(buffer, format, args);
+    char* result = formatArguments(format, args);
     va_end(args);
 
-    return strdup(buffer);
+    return result;
 }
 
 bool isWhitespace(char c)
@@ -53,3 +83,30 @@ char* repeatString(char* string, int times)
 
     return result;
 }
+
+// Raises base to exponent by squaring, wrapping around like the generated
+// code. A negative exponent gives 1 / base^-exponent truncated toward zero,
+// which is 0 unless base is 1 or -1; a zero base must be rejected before.
+int raiseInteger(int base, int exponent)
+{
+    unsigned int factor = base;
+    unsigned int result = 1;
+
+    if (exponent < 0) {
+        if (base != 1 && base != -1) {
+            return 0;
+        }
+
+        exponent &= 1;
+    }
+
+    for (unsigned int remaining = exponent; remaining > 0; remaining >>= 1) {
+        if (remaining & 1) {
+            result *= factor;
+        }
+
+        factor *= factor;
+    }
+
+    return result;
+}
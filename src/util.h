@@ -3,11 +3,15 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdarg.h>
 
 void* safeMalloc(size_t size);
 void* safeRealloc(void* block, size_t size);
+void getAllocationCounts(size_t* count, size_t* bytes);
 char* format(char* format, ...);
+char* formatArguments(char* format, va_list args);
 bool isWhitespace(char c);
 char* repeatString(char* string, int times);
+int raiseInteger(int base, int exponent);
 
 #endif
@@ -0,0 +1,160 @@
+// Scans the same module sequentially and in four chunks and compares the
+// token streams. The module is laid out so that the first three chunk
+// boundaries fall inside a string, a comment and a multibyte identifier.
+#include "../../src/scan.c"
+
+#define CHUNK_COUNT 4
+#define SECTION_SIZE 4096
+
+typedef struct {
+    const char* name;
+    const char* text;
+    size_t offset;
+} Construct;
+
+// Each construct spans a newline, so the chunk following it starts with
+// text that lexes differently when read out of context.
+static Construct constructs[CHUNK_COUNT - 1] = {
+    {"a string", "\"strïng\nπ = 1; /* not a comment\n\";\n", 6},
+    {"a comment", "/* comment\n\"not a string\n */\n", 6},
+    {"an identifier", "const ñandú_éléphant_ünïcode = 1;\nλ = 2;\n", 10}
+};
+
+static const char* statements[] = {
+    "const a = 1 + 2 * 3;\n",
+    "var é = 42;\n",
+    "// ∑ comment\n",
+    "b = 'c' + 1.5;\n",
+    "x += \"text\" == y;\n"
+};
+
+static void append(char* source, size_t* length, const char* text)
+{
+    size_t textLength = strlen(text);
+    memcpy(source + *length, text, textLength);
+    *length += textLength;
+}
+
+static Module* generateModule()
+{
+    size_t count = sizeof(statements) / sizeof(statements[0]);
+    size_t length = 0;
+    char* source = safeMalloc(SECTION_SIZE * CHUNK_COUNT + 64);
+    unsigned int seed = 1;
+
+    for (int i = 0; i < CHUNK_COUNT; i++) {
+        size_t end = SECTION_SIZE * (i + 1);
+        Construct* construct = i < CHUNK_COUNT - 1 ? &constructs[i] : NULL;
+        size_t reserved = construct ? construct->offset : 0;
+
+        while (true) {
+            seed = seed * 1103515245 + 12345;
+            const char* statement = statements[(seed >> 16) % count];
+
+            if (length + strlen(statement) + reserved > end) {
+                break;
+            }
+
+            append(source, &length, statement);
+        }
+
+        while (length + reserved < end) {
+            append(source, &length, " ");
+        }
+
+        if (construct) {
+            append(source, &length, construct->text);
+        }
+    }
+
+    while (length < SECTION_SIZE * CHUNK_COUNT) {
+        append(source, &length, "\n");
+    }
+
+    source[length] = '\0';
+    source[length + 1] = '\0';
+
+    return newModuleFromSource("check", source, length);
+}
+
+static bool isSameToken(Token* a, Token* b)
+{
+    if (a->type != b->type || a->startIndex != b->startIndex || a->length != b->length) {
+        return false;
+    }
+
+    switch (a->type) {
+        case TOKEN_INTEGER: return a->value.integer == b->value.integer;
+        case TOKEN_CHAR: return a->value.c == b->value.c;
+        case TOKEN_FLOAT: return a->value._float == b->value._float;
+        case TOKEN_IDENTIFIER: return a->value.identifier == b->value.identifier;
+        default: return true;
+    }
+}
+
+static Scanner* scanWith(Module* module, int chunkCount)
+{
+    CompilerContext* context = newCompilerContext();
+    context->module = module;
+    Scanner* scanner = newScanner(context, 0, SIZE_MAX);
+
+    if (chunkCount > 1) {
+        scanInParallel(scanner, chunkCount);
+    } else {
+        scanChunk(scanner);
+    }
+
+    return scanner;
+}
+
+static void freeScan(Scanner* scanner)
+{
+    CompilerContext* context = scanner->context;
+
+    for (VECTOR_EACH(scanner->errors)) {
+        freeScanError(VECTOR_GET(scanner->errors, i));
+    }
+
+    freeTokenBuffer(scanner->tokens);
+    freeScanner(scanner);
+    context->module = NULL;
+    freeCompilerContext(context);
+}
+
+int main()
+{
+    Module* module = generateModule();
+    size_t boundaries[SCAN_MAX_CHUNKS + 1];
+    int count = splitChunks(module, CHUNK_COUNT, boundaries);
+    printf("%d chunks\n", count);
+
+    for (int i = 1; i < count; i++) {
+        size_t start = strstr(module->source + SECTION_SIZE * i - constructs[i - 1].offset, constructs[i - 1].text) - module->source;
+        size_t end = start + strlen(constructs[i - 1].text);
+        bool inside = module->length / CHUNK_COUNT * i > start && boundaries[i] > start && boundaries[i] < end;
+        printf("boundary %d inside %s: %s\n", i, constructs[i - 1].name, inside ? "yes" : "no");
+    }
+
+    Scanner* sequential = scanWith(module, 1);
+    Scanner* parallel = scanWith(module, CHUNK_COUNT);
+    TokenBuffer* expected = sequential->tokens;
+    TokenBuffer* actual = parallel->tokens;
+    size_t mismatch = 0;
+
+    while (mismatch < expected->size && mismatch < actual->size && isSameToken(&expected->tokens[mismatch], &actual->tokens[mismatch])) {
+        mismatch++;
+    }
+
+    if (mismatch == expected->size && mismatch == actual->size) {
+        printf("%zu tokens, same as the sequential scan\n", actual->size);
+    } else {
+        printf("tokens differ from the sequential scan at token %zu\n", mismatch);
+    }
+
+    printf("%zu errors, %zu sequential\n", VECTOR_SIZE(parallel->errors), VECTOR_SIZE(sequential->errors));
+    freeScan(sequential);
+    freeScan(parallel);
+    freeModule(module);
+
+    return 0;
+}